@@ -0,0 +1,261 @@
+/*
+ * Copyright (C) 2012-2021 Euclid Science Ground Segment
+ *
+ * This library is free software; you can redistribute it and/or modify it under
+ * the terms of the GNU Lesser General Public License as published by the Free
+ * Software Foundation; either version 3.0 of the License, or (at your option)
+ * any later version.
+ *
+ * This library is distributed in the hope that it will be useful, but WITHOUT
+ * ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS
+ * FOR A PARTICULAR PURPOSE. See the GNU Lesser General Public License for more
+ * details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with this library; if not, write to the Free Software Foundation, Inc.,
+ * 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA
+ */
+
+#ifndef PHYSICSUTILS_PHYSICSUTILS_ACCURACYMONITOR_H_
+#define PHYSICSUTILS_PHYSICSUTILS_ACCURACYMONITOR_H_
+
+#include "CosmologicalDistances.h"
+#include "CosmologicalParameters.h"
+#include "DistanceAggregation.h"
+#include "Quadrature.h"
+#include "Real.h"
+#include "Tracing.h"
+#include <algorithm>
+#include <array>
+#include <atomic>
+#include <condition_variable>
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+#include <deque>
+#include <functional>
+#include <mutex>
+#include <thread>
+
+namespace Euclid {
+namespace PhysicsUtils {
+
+/// A sampled production value further than the tolerance from its reference
+struct AccuracyAlert {
+  double                 z;
+  CosmologicalParameters parameters;
+  double                 value;
+  double                 reference;
+  std::uint64_t          ulps;
+};
+
+/// Distribution of the ULP errors of the samples checked so far
+struct AccuracyReport {
+  /// Bucket 0 counts the exact values, bucket k > 0 the errors in [2^(k-1), 2^k) ULPs
+  std::array<std::uint64_t, 65> histogram{};
+  std::uint64_t                 checked{0};
+  std::uint64_t                 dropped{0};
+  std::uint64_t                 alerts{0};
+  std::uint64_t                 max_ulps{0};
+  /// Samples whose reference or alert callback threw, the worker going on with the next one
+  std::uint64_t                 errors{0};
+};
+
+/**
+ * @class AccuracyMonitor
+ *
+ * @brief Sampled recomputation of production distances at reference precision
+ *
+ * @details observe() is called with the values of the distance kind produced by the fast path;
+ *   one evaluation in sample_interval is queued, at the cost of an atomic increment for the others.
+ *   A background thread recomputes the queued samples with the reference function, by default the
+ *   Romberg distance of that kind converged to 1e-14 or to the ULP criterion, and measures the
+ *   error with FloatingPoint::distanceBetweenSignAndMagnitudeNumbers. Errors beyond max_ulps raise
+ *   an alert through the callback, called on the background thread. An exception of the
+ *   reference or of the callback is counted in the report and does not stop the monitor.
+ *
+ *   The queue is bounded: when the reference cannot keep up the samples are dropped and counted,
+ *   rather than slowing the production path.
+ */
+class AccuracyMonitor {
+public:
+  using Reference = std::function<double(double, const CosmologicalParameters&)>;
+  using Callback  = std::function<void(const AccuracyAlert&)>;
+  using Bits      = Elements::FloatingPoint<double>::Bits;
+
+  /// 2^30 ULPs is a relative error of about 2.4e-7, the order of the default relative_precision
+  static constexpr std::uint64_t s_default_max_ulps = std::uint64_t{1} << 30;
+
+  /// An empty reference selects defaultReference(kind)
+  explicit AccuracyMonitor(DistanceKind kind = DistanceKind::Comoving, std::uint64_t sample_interval = 100000,
+                           std::uint64_t max_ulps = s_default_max_ulps, Callback on_alert = Callback{},
+                           Reference reference = Reference{}, std::size_t queue_capacity = 4096)
+    : m_kind{kind}
+    , m_sample_interval{sample_interval > 0 ? sample_interval : 1}
+    , m_max_ulps{max_ulps}
+    , m_on_alert(std::move(on_alert))
+    , m_reference(reference ? std::move(reference) : defaultReference(kind))
+    , m_queue_capacity{queue_capacity}
+    , m_worker(&AccuracyMonitor::run, this) {}
+
+  AccuracyMonitor(const AccuracyMonitor&)            = delete;
+  AccuracyMonitor& operator=(const AccuracyMonitor&) = delete;
+
+  /// Check the samples still queued and stop the background thread
+  ~AccuracyMonitor() {
+    {
+      std::lock_guard<std::mutex> lock(m_mutex);
+      m_stop = true;
+    }
+    m_wake.notify_one();
+    m_worker.join();
+  }
+
+  /// Record one production evaluation
+  void observe(double z, const CosmologicalParameters& parameters, double value) {
+    if (m_counter.fetch_add(1, std::memory_order_relaxed) % m_sample_interval == 0) {
+      enqueue(Sample{z, parameters, value});
+    }
+  }
+
+  /// Record count production evaluations of a batch
+  void observe(const double* z, std::size_t count, const CosmologicalParameters& parameters, const double* values) {
+    const std::uint64_t first = m_counter.fetch_add(count, std::memory_order_relaxed);
+    // Index in the batch of the first evaluation whose global number is a multiple of the interval
+    std::uint64_t i = (m_sample_interval - first % m_sample_interval) % m_sample_interval;
+    for (; i < count; i += m_sample_interval) {
+      enqueue(Sample{z[i], parameters, values[i]});
+    }
+  }
+
+  /// Block until the queued samples have been checked
+  void flush() {
+    std::unique_lock<std::mutex> lock(m_mutex);
+    m_idle.wait(lock, [this] { return m_queue.empty() && !m_busy; });
+  }
+
+  AccuracyReport report() const {
+    std::lock_guard<std::mutex> lock(m_mutex);
+    return m_report;
+  }
+
+  DistanceKind getKind() const {
+    return m_kind;
+  }
+
+  std::uint64_t getSampleInterval() const {
+    return m_sample_interval;
+  }
+
+  std::uint64_t getMaxUlps() const {
+    return m_max_ulps;
+  }
+
+  /// Distance in ULPs between two doubles, the sign and magnitude encodings being made comparable
+  static std::uint64_t ulpDistance(double a, double b) {
+    Bits a_bits, b_bits;
+    std::memcpy(&a_bits, &a, sizeof(a_bits));
+    std::memcpy(&b_bits, &b, sizeof(b_bits));
+    return Elements::FloatingPoint<double>::distanceBetweenSignAndMagnitudeNumbers(a_bits, b_bits);
+  }
+
+  /// The Romberg distance of kind converged to 1e-14
+  static Reference defaultReference(DistanceKind kind = DistanceKind::Comoving) {
+    return [kind](double z, const CosmologicalParameters& parameters) {
+      const CosmologicalDistances distances{};
+      const double                comoving = distances.comovingDistance(z, parameters, QuadratureConvergence<>{1e-14});
+      if (kind == DistanceKind::Comoving) {
+        return comoving;
+      }
+      const double transverse = distances.transverseFromComoving(comoving, parameters, 1e-14);
+      return kind == DistanceKind::Transverse ? transverse : (1. + z) * transverse;
+    };
+  }
+
+private:
+  struct Sample {
+    double                 z;
+    CosmologicalParameters parameters;
+    double                 value;
+  };
+
+  void enqueue(const Sample& sample) {
+    {
+      std::lock_guard<std::mutex> lock(m_mutex);
+      if (m_queue.size() >= m_queue_capacity) {
+        ++m_report.dropped;
+        return;
+      }
+      m_queue.push_back(sample);
+    }
+    m_wake.notify_one();
+  }
+
+  void run() {
+    std::unique_lock<std::mutex> lock(m_mutex);
+    while (true) {
+      m_wake.wait(lock, [this] { return m_stop || !m_queue.empty(); });
+      if (m_queue.empty()) {
+        return;
+      }
+      const Sample sample = m_queue.front();
+      m_queue.pop_front();
+      m_busy = true;
+      lock.unlock();
+
+      PHYSICSUTILS_TRACE_SCOPE("AccuracyMonitor check", "monitor");
+      bool          checked = false, alert = false, error = false;
+      std::uint64_t ulps    = 0;
+      try {
+        const double reference = m_reference(sample.z, sample.parameters);
+        ulps                   = ulpDistance(sample.value, reference);
+        alert                  = ulps > m_max_ulps;
+        checked                = true;
+        if (alert && m_on_alert) {
+          m_on_alert(AccuracyAlert{sample.z, sample.parameters, sample.value, reference, ulps});
+        }
+      } catch (...) {
+        // An exception escaping the worker would terminate the process
+        error = true;
+      }
+
+      lock.lock();
+      if (checked) {
+        std::size_t bucket = 0;
+        for (std::uint64_t rest = ulps; rest != 0; rest >>= 1) {
+          ++bucket;
+        }
+        ++m_report.histogram[bucket];
+        ++m_report.checked;
+        m_report.alerts += alert;
+        m_report.max_ulps = std::max(m_report.max_ulps, ulps);
+      }
+      m_report.errors += error;
+      m_busy = false;
+      if (m_queue.empty()) {
+        m_idle.notify_all();
+      }
+    }
+  }
+
+  const DistanceKind         m_kind;
+  const std::uint64_t        m_sample_interval;
+  const std::uint64_t        m_max_ulps;
+  Callback                   m_on_alert;
+  Reference                  m_reference;
+  const std::size_t          m_queue_capacity;
+  std::atomic<std::uint64_t> m_counter{0};
+
+  mutable std::mutex      m_mutex;
+  std::condition_variable m_wake;
+  std::condition_variable m_idle;
+  std::deque<Sample>      m_queue;
+  AccuracyReport          m_report;
+  bool                    m_stop{false};
+  bool                    m_busy{false};
+  std::thread             m_worker;
+};
+
+}  // namespace PhysicsUtils
+}  // namespace Euclid
+#endif /* PHYSICSUTILS_PHYSICSUTILS_ACCURACYMONITOR_H_ */
@@ -0,0 +1,457 @@
+/*
+ * Copyright (C) 2012-2021 Euclid Science Ground Segment
+ *
+ * This library is free software; you can redistribute it and/or modify it under
+ * the terms of the GNU Lesser General Public License as published by the Free
+ * Software Foundation; either version 3.0 of the License, or (at your option)
+ * any later version.
+ *
+ * This library is distributed in the hope that it will be useful, but WITHOUT
+ * ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS
+ * FOR A PARTICULAR PURPOSE. See the GNU Lesser General Public License for more
+ * details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with this library; if not, write to the Free Software Foundation, Inc.,
+ * 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA
+ */
+
+#ifndef PHYSICSUTILS_PHYSICSUTILS_ARROWWRITER_H_
+#define PHYSICSUTILS_PHYSICSUTILS_ARROWWRITER_H_
+
+#include "CosmologicalDistances.h"
+#include "CosmologicalParameters.h"
+#include "Tracing.h"
+#include <algorithm>
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+#include <ostream>
+#include <stdexcept>
+#include <string>
+#include <utility>
+#include <vector>
+
+namespace Euclid {
+namespace PhysicsUtils {
+
+namespace Detail {
+
+/**
+ * @class FlatBufferBuilder
+ *
+ * @brief The subset of the FlatBuffers encoding needed by the Arrow IPC metadata
+ *
+ * @details As in the reference implementation the buffer is built from its end: a reference to
+ *   an object is its distance from the end of the buffer, which does not change as the buffer
+ *   grows at the front. Every field is written, defaults included, and the vtables are not
+ *   shared, which only costs a few bytes for the small Arrow messages.
+ */
+class FlatBufferBuilder {
+public:
+  using Reference = std::uint32_t;
+
+  template <typename T>
+  void addScalar(std::uint16_t slot, T value) {
+    prepend(value);
+    m_fields.emplace_back(slot, size());
+  }
+
+  void addReference(std::uint16_t slot, Reference reference) {
+    prependReference(reference);
+    m_fields.emplace_back(slot, size());
+  }
+
+  void startTable() {
+    m_fields.clear();
+    m_table_start = size();
+  }
+
+  Reference endTable() {
+    prepend<std::int32_t>(0);
+    const Reference table = size();
+
+    std::uint16_t slots = 0;
+    for (const auto& field : m_fields) {
+      slots = std::max<std::uint16_t>(slots, field.first + 1);
+    }
+    std::vector<std::uint16_t> vtable(2 + slots, 0);
+    vtable[0] = static_cast<std::uint16_t>(vtable.size() * sizeof(std::uint16_t));
+    vtable[1] = static_cast<std::uint16_t>(table - m_table_start);
+    for (const auto& field : m_fields) {
+      vtable[2 + field.first] = static_cast<std::uint16_t>(table - field.second);
+    }
+    for (auto entry = vtable.rbegin(); entry != vtable.rend(); ++entry) {
+      prepend(*entry);
+    }
+    // The table starts with the signed distance from the vtable, which precedes it
+    const std::int32_t vtable_offset = static_cast<std::int32_t>(size() - table);
+    std::memcpy(&m_data[m_data.size() - table], &vtable_offset, sizeof(vtable_offset));
+    m_fields.clear();
+    return table;
+  }
+
+  Reference createString(const std::string& value) {
+    align(sizeof(std::uint32_t), value.size() + 1);
+    m_data.insert(m_data.begin(), 1, 0);
+    m_data.insert(m_data.begin(), value.begin(), value.end());
+    prepend(static_cast<std::uint32_t>(value.size()));
+    return size();
+  }
+
+  Reference createVector(const std::vector<Reference>& references) {
+    align(sizeof(std::uint32_t), references.size() * sizeof(std::uint32_t));
+    for (auto reference = references.rbegin(); reference != references.rend(); ++reference) {
+      prependReference(*reference);
+    }
+    prepend(static_cast<std::uint32_t>(references.size()));
+    return size();
+  }
+
+  /// Vector of structs made of int64, given as their flattened members
+  Reference createStructVector(const std::vector<std::int64_t>& members, std::size_t members_per_struct) {
+    align(sizeof(std::int64_t), members.size() * sizeof(std::int64_t));
+    for (auto member = members.rbegin(); member != members.rend(); ++member) {
+      prepend(*member);
+    }
+    prepend(static_cast<std::uint32_t>(members.size() / std::max<std::size_t>(members_per_struct, 1)));
+    return size();
+  }
+
+  /// The buffer with root as its root table, padded to a multiple of 8 bytes
+  std::vector<std::uint8_t> finish(Reference root) {
+    align(s_max_alignment, sizeof(std::uint32_t));
+    prependReference(root);
+    return m_data;
+  }
+
+private:
+  static constexpr std::size_t s_max_alignment = 8;
+
+  Reference size() const {
+    return static_cast<Reference>(m_data.size());
+  }
+
+  /// Pad so that once extra bytes are prepended the buffer size is a multiple of alignment
+  void align(std::size_t alignment, std::size_t extra) {
+    const std::size_t padding = (alignment - (m_data.size() + extra) % alignment) % alignment;
+    m_data.insert(m_data.begin(), padding, 0);
+  }
+
+  template <typename T>
+  void prepend(T value) {
+    align(sizeof(T), sizeof(T));
+    std::uint8_t bytes[sizeof(T)];
+    std::memcpy(bytes, &value, sizeof(T));
+    m_data.insert(m_data.begin(), bytes, bytes + sizeof(T));
+  }
+
+  /// A uoffset is relative to its own position
+  void prependReference(Reference reference) {
+    align(sizeof(std::uint32_t), sizeof(std::uint32_t));
+    prepend(static_cast<std::uint32_t>(size() + sizeof(std::uint32_t) - reference));
+  }
+
+  std::vector<std::uint8_t>                        m_data;
+  std::vector<std::pair<std::uint16_t, Reference>> m_fields;
+  Reference                                        m_table_start{0};
+};
+
+}  // namespace Detail
+
+/**
+ * @class ArrowWriter
+ *
+ * @brief Writer of float64 columns in the Arrow IPC format, with no dependency on Arrow
+ *
+ * @details Each call to write() appends a record batch whose body is written straight from the
+ *   column arrays, with no intermediate copy. The File format ends with the footer that indexes
+ *   the batches, so that readers can memory-map the result and use the columns in place; the
+ *   Stream format ends with the end-of-stream marker and can be piped. The Batches format has no
+ *   schema message: it continues a Stream output whose end-of-stream marker has been cut, the
+ *   s_end_of_stream_size last bytes, so that an append-only catalog can grow its outputs in place.
+ *
+ *   The metadata follows the version 5 Arrow schema (Schema.fbs, Message.fbs, File.fbs). The
+ *   columns are non-nullable, the buffers are aligned on 64 bytes and little endian is assumed.
+ */
+class ArrowWriter {
+public:
+  enum class Format { File, Stream, Batches };
+
+  /// Size of the marker that close() writes at the end of the Stream and Batches formats
+  static constexpr std::size_t s_end_of_stream_size = 8;
+
+  /**
+   * @brief Start writing to out
+   * @details start_offset is the position in the output of the first byte written. It is for the
+   *   Batches format, appended after start_offset bytes of an existing stream, so that the bodies
+   *   are aligned in the whole output and not only in what this writer appends.
+   * @throws std::invalid_argument if start_offset is negative, or not 0 for the File and Stream formats
+   */
+  ArrowWriter(std::ostream& out, std::vector<std::string> column_names, Format format = Format::File,
+              std::int64_t start_offset = 0)
+    : m_out(out), m_names(std::move(column_names)), m_format{format}, m_offset{start_offset} {
+    if (start_offset < 0 || (start_offset != 0 && m_format != Format::Batches)) {
+      throw std::invalid_argument("ArrowWriter: only the Batches format starts after existing data");
+    }
+    if (m_format == Format::File) {
+      writeBytes(s_magic, sizeof(s_magic));
+      writePadding(2);
+    }
+    if (m_format != Format::Batches) {
+      writeMessage(schemaMessage(), 0);
+    }
+  }
+
+  ArrowWriter(const ArrowWriter&)            = delete;
+  ArrowWriter& operator=(const ArrowWriter&) = delete;
+
+  ~ArrowWriter() {
+    try {
+      close();
+    } catch (...) {
+      // Nothing sensible to do in a destructor, close() explicitly to get the error
+    }
+  }
+
+  std::size_t columnCount() const {
+    return m_names.size();
+  }
+
+  /**
+   * @brief Append a record batch of rows values per column
+   * @throws std::invalid_argument if the number of columns differs from the schema
+   * @throws std::runtime_error if the stream fails or the writer is closed
+   */
+  void write(const std::vector<const double*>& columns, std::size_t rows) {
+    PHYSICSUTILS_TRACE_SCOPE("ArrowWriter write", "io");
+    if (m_closed) {
+      throw std::runtime_error("ArrowWriter: write after close");
+    }
+    if (columns.size() != m_names.size()) {
+      throw std::invalid_argument("ArrowWriter: the number of columns does not match the schema");
+    }
+    const std::int64_t column_bytes = static_cast<std::int64_t>(rows * sizeof(double));
+    const std::int64_t padded_bytes = pad(column_bytes, s_buffer_alignment);
+    // Two buffers per column, an empty validity bitmap and the values
+    std::vector<std::int64_t> nodes, buffers;
+    for (std::size_t column = 0; column < columns.size(); ++column) {
+      const std::int64_t offset = static_cast<std::int64_t>(column) * padded_bytes;
+      nodes.insert(nodes.end(), {static_cast<std::int64_t>(rows), 0});
+      buffers.insert(buffers.end(), {offset, 0, offset, column_bytes});
+    }
+    const std::int64_t body_length = padded_bytes * static_cast<std::int64_t>(columns.size());
+
+    Detail::FlatBufferBuilder builder;
+    const auto                node_vector   = builder.createStructVector(nodes, 2);
+    const auto                buffer_vector = builder.createStructVector(buffers, 2);
+    builder.startTable();
+    builder.addScalar<std::int64_t>(0, static_cast<std::int64_t>(rows));
+    builder.addReference(1, node_vector);
+    builder.addReference(2, buffer_vector);
+    const auto batch = builder.endTable();
+
+    m_batch_blocks.push_back(writeMessage(message(builder, s_record_batch, batch, body_length), body_length));
+    for (const double* column : columns) {
+      writeBytes(column, static_cast<std::size_t>(column_bytes));
+      writePadding(static_cast<std::size_t>(padded_bytes - column_bytes));
+    }
+    m_rows += rows;
+  }
+
+  /// Number of rows written so far
+  std::size_t rowCount() const {
+    return m_rows;
+  }
+
+  /// Write the end-of-stream marker and, for the File format, the footer
+  void close() {
+    if (m_closed) {
+      return;
+    }
+    m_closed = true;
+    const std::uint32_t end_of_stream[] = {s_continuation, 0};
+    static_assert(sizeof(end_of_stream) == s_end_of_stream_size, "The end-of-stream marker is two words");
+    writeBytes(end_of_stream, sizeof(end_of_stream));
+    if (m_format == Format::File) {
+      const std::vector<std::uint8_t> footer = footerBuffer();
+      const std::int32_t              length = static_cast<std::int32_t>(footer.size());
+      writeBytes(footer.data(), footer.size());
+      writeBytes(&length, sizeof(length));
+      writeBytes(s_magic, sizeof(s_magic));
+    }
+    m_out.flush();
+    if (!m_out) {
+      throw std::runtime_error("ArrowWriter: failed to write the stream");
+    }
+  }
+
+private:
+  /// File offset, metadata length and body length of a message, as in the Block struct of the footer
+  struct Block {
+    std::int64_t offset;
+    std::int64_t metadata_length;
+    std::int64_t body_length;
+  };
+
+  static constexpr char          s_magic[6]         = {'A', 'R', 'R', 'O', 'W', '1'};
+  static constexpr std::uint32_t s_continuation     = 0xFFFFFFFF;
+  static constexpr std::int16_t  s_metadata_v5      = 4;
+  static constexpr std::uint8_t  s_schema           = 1;
+  static constexpr std::uint8_t  s_record_batch     = 3;
+  static constexpr std::uint8_t  s_floating_point   = 3;
+  static constexpr std::int16_t  s_double           = 2;
+  static constexpr std::int64_t  s_buffer_alignment = 64;
+
+  static std::int64_t pad(std::int64_t value, std::int64_t alignment) {
+    return (value + alignment - 1) / alignment * alignment;
+  }
+
+  /// Schema table, whose fields are float64 columns
+  Detail::FlatBufferBuilder::Reference schema(Detail::FlatBufferBuilder& builder) const {
+    std::vector<Detail::FlatBufferBuilder::Reference> fields;
+    for (const auto& name : m_names) {
+      const auto field_name = builder.createString(name);
+      builder.startTable();
+      builder.addScalar<std::int16_t>(0, s_double);
+      const auto type     = builder.endTable();
+      const auto children = builder.createVector({});
+      builder.startTable();
+      builder.addReference(0, field_name);
+      builder.addScalar<std::uint8_t>(1, 0);
+      builder.addScalar<std::uint8_t>(2, s_floating_point);
+      builder.addReference(3, type);
+      builder.addReference(5, children);
+      fields.push_back(builder.endTable());
+    }
+    const auto field_vector = builder.createVector(fields);
+    builder.startTable();
+    builder.addScalar<std::int16_t>(0, 0);
+    builder.addReference(1, field_vector);
+    return builder.endTable();
+  }
+
+  std::vector<std::uint8_t> schemaMessage() const {
+    Detail::FlatBufferBuilder builder;
+    const auto                header = schema(builder);
+    return message(builder, s_schema, header, 0);
+  }
+
+  static std::vector<std::uint8_t> message(Detail::FlatBufferBuilder& builder, std::uint8_t header_type,
+                                           Detail::FlatBufferBuilder::Reference header, std::int64_t body_length) {
+    builder.startTable();
+    builder.addScalar<std::int64_t>(3, body_length);
+    builder.addReference(2, header);
+    builder.addScalar<std::int16_t>(0, s_metadata_v5);
+    builder.addScalar<std::uint8_t>(1, header_type);
+    return builder.finish(builder.endTable());
+  }
+
+  std::vector<std::uint8_t> footerBuffer() const {
+    Detail::FlatBufferBuilder builder;
+    const auto                header = schema(builder);
+    std::vector<std::int64_t> blocks;
+    for (const auto& block : m_batch_blocks) {
+      // The int32 metadata length is followed by 4 bytes of padding in the struct
+      blocks.insert(blocks.end(), {block.offset, block.metadata_length, block.body_length});
+    }
+    const auto batches      = builder.createStructVector(blocks, 3);
+    const auto dictionaries = builder.createStructVector({}, 3);
+    builder.startTable();
+    builder.addReference(1, header);
+    builder.addReference(2, dictionaries);
+    builder.addReference(3, batches);
+    builder.addScalar<std::int16_t>(0, s_metadata_v5);
+    return builder.finish(builder.endTable());
+  }
+
+  /**
+   * Encapsulated message: continuation marker, metadata length, then the metadata padded so that
+   * the body starts on a buffer boundary of the file
+   */
+  Block writeMessage(const std::vector<std::uint8_t>& metadata, std::int64_t body_length) {
+    const std::int64_t  alignment = body_length > 0 ? s_buffer_alignment : 8;
+    const std::int64_t  prefixed  = m_offset + 8 + static_cast<std::int64_t>(metadata.size());
+    const std::int64_t  padded    = pad(prefixed, alignment) - m_offset - 8;
+    const std::uint32_t prefix[]  = {s_continuation, static_cast<std::uint32_t>(padded)};
+    const Block         block{m_offset, padded + 8, body_length};
+    writeBytes(prefix, sizeof(prefix));
+    writeBytes(metadata.data(), metadata.size());
+    writePadding(static_cast<std::size_t>(padded) - metadata.size());
+    return block;
+  }
+
+  void writeBytes(const void* data, std::size_t size) {
+    m_out.write(static_cast<const char*>(data), static_cast<std::streamsize>(size));
+    if (!m_out) {
+      throw std::runtime_error("ArrowWriter: failed to write the stream");
+    }
+    m_offset += static_cast<std::int64_t>(size);
+  }
+
+  void writePadding(std::size_t size) {
+    static const char zeros[s_buffer_alignment] = {};
+    while (size > 0) {
+      const std::size_t chunk = std::min<std::size_t>(size, sizeof(zeros));
+      writeBytes(zeros, chunk);
+      size -= chunk;
+    }
+  }
+
+  std::ostream&            m_out;
+  std::vector<std::string> m_names;
+  Format                   m_format;
+  std::int64_t             m_offset{0};
+  std::vector<Block>       m_batch_blocks;
+  std::size_t              m_rows{0};
+  bool                     m_closed{false};
+};
+
+/// Column names of the outputs of writeArrowDistances
+inline std::vector<std::string> arrowDistanceColumns() {
+  return {"z", "comoving", "transverse", "luminosity"};
+}
+
+/**
+ * @brief Append the distances of the count redshifts in z to writer, whose columns are
+ *   arrowDistanceColumns()
+ * @details The comoving distances are the Romberg integrals of the batch API of
+ *   CosmologicalDistances converged to relative_precision, computed in record batches of
+ *   batch_rows rows so that the memory use does not grow with count. The transverse and
+ *   luminosity distances are derived from them without another integration, which gives the
+ *   values of the batch API for the same precision. A batch_rows of 0 is taken as 1.
+ */
+inline void appendArrowDistances(ArrowWriter& writer, const double* z, std::size_t count,
+                                 const CosmologicalParameters& parameters, std::size_t batch_rows = 1 << 16,
+                                 double relative_precision = 0.0000001) {
+  CosmologicalDistances distances{};
+  const std::size_t     rows_per_batch = std::max<std::size_t>(batch_rows, 1);
+  std::vector<double>   comoving(std::min(count, rows_per_batch)), transverse(comoving.size()),
+      luminosity(comoving.size());
+  for (std::size_t begin = 0; begin < count; begin += rows_per_batch) {
+    const std::size_t rows = std::min(rows_per_batch, count - begin);
+    distances.comovingDistance(z + begin, rows, comoving.data(), parameters, relative_precision);
+    for (std::size_t i = 0; i < rows; ++i) {
+      transverse[i] = distances.transverseFromComoving(comoving[i], parameters, relative_precision);
+      luminosity[i] = (1. + z[begin + i]) * transverse[i];
+    }
+    writer.write({z + begin, comoving.data(), transverse.data(), luminosity.data()}, rows);
+  }
+}
+
+/**
+ * @brief Write the comoving, transverse comoving and luminosity distances of the count redshifts
+ *   in z as an Arrow file with the columns z, comoving, transverse and luminosity
+ */
+inline void writeArrowDistances(std::ostream& out, const double* z, std::size_t count,
+                                const CosmologicalParameters& parameters, std::size_t batch_rows = 1 << 16,
+                                ArrowWriter::Format format             = ArrowWriter::Format::File,
+                                double              relative_precision = 0.0000001) {
+  ArrowWriter writer{out, arrowDistanceColumns(), format};
+  appendArrowDistances(writer, z, count, parameters, batch_rows, relative_precision);
+  writer.close();
+}
+
+}  // namespace PhysicsUtils
+}  // namespace Euclid
+#endif /* PHYSICSUTILS_PHYSICSUTILS_ARROWWRITER_H_ */
@@ -0,0 +1,273 @@
+/*
+ * Copyright (C) 2012-2021 Euclid Science Ground Segment
+ *
+ * This library is free software; you can redistribute it and/or modify it under
+ * the terms of the GNU Lesser General Public License as published by the Free
+ * Software Foundation; either version 3.0 of the License, or (at your option)
+ * any later version.
+ *
+ * This library is distributed in the hope that it will be useful, but WITHOUT
+ * ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS
+ * FOR A PARTICULAR PURPOSE. See the GNU Lesser General Public License for more
+ * details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with this library; if not, write to the Free Software Foundation, Inc.,
+ * 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA
+ */
+
+#ifndef PHYSICSUTILS_PHYSICSUTILS_CERTIFIEDDISTANCES_H_
+#define PHYSICSUTILS_PHYSICSUTILS_CERTIFIEDDISTANCES_H_
+
+#include "CosmologicalDistances.h"
+#include "CosmologicalParameters.h"
+#include "Interval.h"
+#include "Tracing.h"
+#include <algorithm>
+#include <cmath>
+#include <cstddef>
+#include <limits>
+#include <numeric>
+#include <stdexcept>
+#include <vector>
+
+namespace Euclid {
+namespace PhysicsUtils {
+
+/**
+ * @class CertifiedDistances
+ *
+ * @brief Rigorous lower and upper bounds on the comoving and transverse comoving distances
+ *
+ * @details The integral \f$\int_0^z dz'/E(z')\f$ is split in panels of panel_width. On each panel
+ *   the integrand \f$f = P^{-1/2}\f$, with \f$P = \Omega_m x^3 + \Omega_k x^2 + \Omega_\Lambda\f$ and
+ *   \f$x = 1 + z\f$, is expanded to second order around the panel midpoint m:
+ *   \f[
+ *   \int_a^b f = f(m) (b - a) + f'(m) \frac{(b - m)^2 - (a - m)^2}{2} + f''(\xi) \frac{(b - m)^3 - (a - m)^3}{6}
+ *   \f]
+ *   where \f$f''(\xi)\f$ is enclosed by evaluating \f$f''\f$ in interval arithmetic over the whole
+ *   panel. Every step is computed with Interval, so the result contains the exact integral for the
+ *   parameters as they are represented in double. The enclosure width shrinks as panel_width^2.
+ *
+ *   Above s_uniform_range the panels keep the width in ln(1 + z) that they have there, so that
+ *   the relative size of the remainder term stays the same while the number of panels only grows
+ *   as ln(1 + z): about 27000 up to z = 1e12 for the default panel_width, instead of 6e13. The
+ *   panel edges all come from panelEdge(), so consecutive panels share the same rounded endpoint
+ *   and tile [0, z] exactly. Beyond s_tail_start, where P would soon overflow, the rest of the
+ *   integral is enclosed by [0, T] with T its bound to infinity: for \f$x \ge x_t\f$,
+ *   \f$P \ge q x^3\f$ with \f$q = \Omega_m - |\Omega_k| / x_t - |\Omega_\Lambda| / x_t^3\f$, so
+ *   \f$T = 2 / \sqrt{q x_t}\f$, a relative width of about 1e-8. Without matter, q <= 0 and T is infinite.
+ *
+ *   The batch methods sort the redshifts and accumulate the panels once for the whole batch, so
+ *   their cost is one pass over the panels up to the largest redshift plus one partial panel per
+ *   object.
+ *   A universe without a big bang (P <= 0 somewhere on [0, z]) gets infinite bounds, a negative or
+ *   non-finite redshift a NaN interval.
+ */
+class CertifiedDistances {
+public:
+  /// Redshift up to which the panels have a constant width
+  static constexpr double s_uniform_range = 16.;
+
+  /// Redshift from which the integral is enclosed by its asymptotic tail instead of panels
+  static constexpr double s_tail_start = 1e16;
+
+  /// @throws std::invalid_argument unless panel_width is finite and positive
+  explicit CertifiedDistances(double panel_width = 1. / 64)
+    : m_panel_width{checkPanelWidth(panel_width)}
+    , m_uniform_panels{static_cast<std::size_t>(std::ceil(s_uniform_range / panel_width))}
+    , m_uniform_end{static_cast<double>(m_uniform_panels) * panel_width}
+    , m_log_width{panel_width / (1. + m_uniform_end)} {}
+
+  Interval comovingDistance(double z, const CosmologicalParameters& parameters) const {
+    Interval out;
+    comovingDistance(&z, 1, &out, parameters);
+    return out;
+  }
+
+  Interval transverseComovingDistance(double z, const CosmologicalParameters& parameters) const {
+    Interval out;
+    transverseComovingDistance(&z, 1, &out, parameters);
+    return out;
+  }
+
+  void comovingDistance(const double* z, std::size_t count, Interval* out,
+                        const CosmologicalParameters& parameters) const {
+    PHYSICSUTILS_TRACE_SCOPE("CertifiedDistances batch", "quadrature");
+    const Interval hubble_distance = Interval{CosmologicalDistances::s_speed_of_light} / parameters.getHubbleConstant();
+    integrate(z, count, out, parameters);
+    for (std::size_t i = 0; i < count; ++i) {
+      out[i] = hubble_distance * out[i];
+    }
+  }
+
+  void transverseComovingDistance(const double* z, std::size_t count, Interval* out,
+                                  const CosmologicalParameters& parameters) const {
+    PHYSICSUTILS_TRACE_SCOPE("CertifiedDistances batch", "quadrature");
+    const Interval hubble_distance = Interval{CosmologicalDistances::s_speed_of_light} / parameters.getHubbleConstant();
+    const double   omega_k         = parameters.getOmegaK();
+    const Interval sqrt_omega_k    = sqrt(Interval{std::abs(omega_k)});
+    integrate(z, count, out, parameters);
+    for (std::size_t i = 0; i < count; ++i) {
+      out[i] = hubble_distance * transverse(out[i], omega_k, sqrt_omega_k);
+    }
+  }
+
+private:
+  struct Coefficients {
+    double omega_m, omega_k, omega_lambda;
+  };
+
+  static double checkPanelWidth(double panel_width) {
+    if (!std::isfinite(panel_width) || !(panel_width > 0.)) {
+      throw std::invalid_argument("CertifiedDistances: panel_width must be finite and positive");
+    }
+    return panel_width;
+  }
+
+  /// Lower edge of panel k, uniform up to m_uniform_end then geometric in 1 + z
+  double panelEdge(std::size_t k) const {
+    if (k <= m_uniform_panels) {
+      return static_cast<double>(k) * m_panel_width;
+    }
+    return (1. + m_uniform_end) * std::exp(static_cast<double>(k - m_uniform_panels) * m_log_width) - 1.;
+  }
+
+  /// Enclosure of the integral of 1/E between a and b, both within one panel
+  static Interval panel(double a, double b, const Coefficients& c) {
+    if (!(b > a)) {
+      return Interval{0.};
+    }
+    const double   m     = 0.5 * a + 0.5 * b;
+    const Interval left  = Interval{a} - m;
+    const Interval right = Interval{b} - m;
+    const Interval width = Interval{b} - a;
+
+    // f and f' at the midpoint
+    const Interval x_m = Interval{1.} + m;
+    const Interval p_m = polynomial(x_m, c);
+    if (!(p_m.lower() > 0.)) {
+      return unbounded();
+    }
+    const Interval f_m       = Interval{1.} / sqrt(p_m);
+    const Interval f_prime_m = Interval{-0.5} * f_m / p_m * derivative(x_m, c);
+
+    // f'' over the whole panel
+    const Interval x = Interval{1.} + Interval{a, b};
+    const Interval p = polynomial(x, c);
+    if (!(p.lower() > 0.)) {
+      return unbounded();
+    }
+    const Interval f        = Interval{1.} / sqrt(p);
+    const Interval f_over_p = f / p;
+    const Interval p_prime  = derivative(x, c);
+    const Interval f_second =
+        Interval{0.75} * f_over_p / p * square(p_prime) - Interval{0.5} * f_over_p * secondDerivative(x, c);
+
+    return f_m * width + f_prime_m * (square(right) - square(left)) * 0.5 +
+           f_second * (right * square(right) - left * square(left)) / 6.;
+  }
+
+  static Interval polynomial(const Interval& x, const Coefficients& c) {
+    return (Interval{c.omega_m} * x + c.omega_k) * square(x) + c.omega_lambda;
+  }
+
+  static Interval derivative(const Interval& x, const Coefficients& c) {
+    return (Interval{c.omega_m} * 3. * x + Interval{c.omega_k} * 2.) * x;
+  }
+
+  static Interval secondDerivative(const Interval& x, const Coefficients& c) {
+    return Interval{c.omega_m} * 6. * x + Interval{c.omega_k} * 2.;
+  }
+
+  /**
+   * Enclosure of D_M / D_H for the dimensionless comoving distance integral, the interval form of
+   * CosmologicalDistances::transverseRatio(). The series of the same coefficients is used while
+   * its remainder, below 2 |x|^n / (2n + 1)! for |x| < (2n + 2)(2n + 3) / 2, is under an ULP, and
+   * the remainder is added to the enclosure. Otherwise sinh or sin is applied to sqrt(|Omega_k|)
+   * times the integral, where the integral appears once and does not widen the result.
+   */
+  static Interval transverse(const Interval& integral, double omega_k, const Interval& sqrt_omega_k) {
+    constexpr std::size_t terms = CosmologicalDistances::s_curvature_terms;
+    if (omega_k == 0.) {
+      return integral;
+    }
+    const Interval x         = Interval{omega_k} * square(integral);
+    const double   bound     = std::max(std::abs(x.lower()), std::abs(x.upper()));
+    const double   bound3    = bound * bound * bound;
+    const double   remainder =
+        Interval::roundUp(2. * bound3 * bound3 / CosmologicalDistances::s_transverse_next_factorial, 8);
+    if (remainder <= std::numeric_limits<double>::epsilon()) {
+      // The coefficients are 1 / (2n + 1)! rounded to nearest, so each is widened by an ULP
+      Interval series = coefficient(CosmologicalDistances::s_transverse_series[terms - 1]);
+      for (std::size_t n = terms - 1; n > 0; --n) {
+        series = series * x + coefficient(CosmologicalDistances::s_transverse_series[n - 1]);
+      }
+      return integral * (series + Interval{-remainder, remainder});
+    }
+    if (omega_k > 0.) {
+      return sinh(sqrt_omega_k * integral) / sqrt_omega_k;
+    }
+    return sin(sqrt_omega_k * integral) / sqrt_omega_k;
+  }
+
+  static Interval coefficient(double rounded) {
+    return Interval{Interval::roundDown(rounded), Interval::roundUp(rounded)};
+  }
+
+  /// Enclosure of the integral from s_tail_start to any larger redshift, see the class documentation
+  static Interval tail(const Coefficients& c) {
+    const Interval x_t{(Interval{1.} + s_tail_start).lower()};
+    const Interval q = Interval{c.omega_m} - Interval{std::abs(c.omega_k)} / x_t -
+                       Interval{std::abs(c.omega_lambda)} / (x_t * square(x_t));
+    if (!(q.lower() > 0.)) {
+      return Interval{0., std::numeric_limits<double>::infinity()};
+    }
+    return Interval{0., (Interval{2.} / sqrt(Interval{q.lower()} * x_t)).upper()};
+  }
+
+  static Interval unbounded() {
+    return Interval{-std::numeric_limits<double>::infinity(), std::numeric_limits<double>::infinity()};
+  }
+
+  /// Dimensionless comoving distance enclosures, walking the panels once in increasing redshift
+  void integrate(const double* z, std::size_t count, Interval* out, const CosmologicalParameters& parameters) const {
+    const Coefficients       c{parameters.getOmegaM(), parameters.getOmegaK(), parameters.getOmegaLambda()};
+    std::vector<std::size_t> order(count);
+    std::iota(order.begin(), order.end(), 0);
+    // The non-finite redshifts go last, so that the comparison is a strict weak order
+    std::sort(order.begin(), order.end(), [z](std::size_t i, std::size_t j) {
+      const bool finite_i = std::isfinite(z[i]), finite_j = std::isfinite(z[j]);
+      return finite_i != finite_j ? finite_i : finite_i && z[i] < z[j];
+    });
+
+    Interval    accumulated{0.};
+    std::size_t panel_index = 0;
+    for (std::size_t i : order) {
+      if (!std::isfinite(z[i]) || z[i] < 0.) {
+        out[i] = Interval{std::numeric_limits<double>::quiet_NaN()};
+        continue;
+      }
+      // Whole panels below z. Consecutive panels share the same rounded endpoint, so they tile [0, z] exactly
+      const double end = std::min(z[i], s_tail_start);
+      while (panelEdge(panel_index + 1) <= end) {
+        accumulated += panel(panelEdge(panel_index), panelEdge(panel_index + 1), c);
+        ++panel_index;
+      }
+      out[i] = accumulated + panel(panelEdge(panel_index), end, c);
+      if (z[i] > s_tail_start) {
+        out[i] += tail(c);
+      }
+    }
+  }
+
+  double      m_panel_width;
+  std::size_t m_uniform_panels;
+  double      m_uniform_end;
+  /// Width of the geometric panels in ln(1 + z)
+  double      m_log_width;
+};
+
+}  // namespace PhysicsUtils
+}  // namespace Euclid
+#endif /* PHYSICSUTILS_PHYSICSUTILS_CERTIFIEDDISTANCES_H_ */
@@ -0,0 +1,178 @@
+/*
+ * Copyright (C) 2012-2021 Euclid Science Ground Segment
+ *
+ * This library is free software; you can redistribute it and/or modify it under
+ * the terms of the GNU Lesser General Public License as published by the Free
+ * Software Foundation; either version 3.0 of the License, or (at your option)
+ * any later version.
+ *
+ * This library is distributed in the hope that it will be useful, but WITHOUT
+ * ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS
+ * FOR A PARTICULAR PURPOSE. See the GNU Lesser General Public License for more
+ * details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with this library; if not, write to the Free Software Foundation, Inc.,
+ * 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA
+ */
+
+#ifndef PHYSICSUTILS_PHYSICSUTILS_COLUMNSANITIZER_H_
+#define PHYSICSUTILS_PHYSICSUTILS_COLUMNSANITIZER_H_
+
+#include "Real.h"
+#include "Tracing.h"
+#include <algorithm>
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+#include <limits>
+
+namespace Euclid {
+namespace PhysicsUtils {
+
+/// Classes of the values of an input column as a set of the ValueFlag bits, 0 being a clean value
+using ValueFlags = std::uint8_t;
+
+/// The bits of ValueFlags
+struct ValueFlag {
+  static constexpr ValueFlags s_nan       = 1;
+  static constexpr ValueFlags s_infinite  = 2;
+  static constexpr ValueFlags s_negative  = 4;
+  static constexpr ValueFlags s_subnormal = 8;
+  static constexpr ValueFlags s_all       = s_nan | s_infinite | s_negative | s_subnormal;
+};
+
+/// Number of values of each class found by ColumnSanitizer
+struct ColumnReport {
+  std::size_t valid{0};
+  std::size_t nan{0};
+  std::size_t infinite{0};
+  std::size_t negative{0};
+  std::size_t subnormal{0};
+};
+
+/**
+ * @class ColumnSanitizer
+ *
+ * @brief Single pass IEEE 754 classification of an input column
+ *
+ * @details Each value is classified from its bits with the exponent, fraction and sign masks of
+ *   Elements::FloatingPoint, with integer operations only and no branch, so that the sweep
+ *   vectorizes. -0 is a clean zero. The values whose flags intersect the rejected flags are
+ *   invalid; the indices and values of the others are compacted with a branch-free store, so the
+ *   distance kernels can run on the compacted column without any check and scatter() puts their
+ *   results back in place.
+ */
+template <typename RawType = double>
+class ColumnSanitizer {
+public:
+  using FloatingPoint = Elements::FloatingPoint<RawType>;
+  using Bits          = typename FloatingPoint::Bits;
+
+  explicit ColumnSanitizer(ValueFlags rejected = ValueFlag::s_all) : m_rejected{rejected} {}
+
+  /// Flags of one value
+  static ValueFlags classify(RawType value) {
+    Bits bits;
+    std::memcpy(&bits, &value, sizeof(bits));
+    return classifyBits(bits);
+  }
+
+  /// Flags of the bit pattern of a value
+  static ValueFlags classifyBits(Bits bits) {
+    const Bits exponent = bits & FloatingPoint::s_exponent_bitmask;
+    const Bits fraction = bits & FloatingPoint::s_fraction_bitmask;
+    const bool all_ones = exponent == FloatingPoint::s_exponent_bitmask;
+    const bool zero_exp = exponent == 0;
+    const bool is_zero  = zero_exp & (fraction == 0);
+    const bool negative = ((bits & FloatingPoint::s_sign_bitmask) != 0) & !is_zero & !(all_ones & (fraction != 0));
+    return static_cast<ValueFlags>(
+        (all_ones & (fraction != 0)) * ValueFlag::s_nan | (all_ones & (fraction == 0)) * ValueFlag::s_infinite |
+        negative * ValueFlag::s_negative | (zero_exp & (fraction != 0)) * ValueFlag::s_subnormal);
+  }
+
+  /**
+   * @brief Classify the count values of column
+   * @details flags, which may be null, receives the flags of every value. indices and values, which
+   *   may be both null, the positions and values of the valid ones, in order; they must have room
+   *   for count elements.
+   * @return the number of values of each class, valid being the length of the compacted output
+   */
+  ColumnReport sanitize(const RawType* column, std::size_t count, ValueFlags* flags, std::size_t* indices,
+                        RawType* values) const {
+    PHYSICSUTILS_TRACE_SCOPE("ColumnSanitizer sanitize", "input");
+    ColumnReport report;
+    std::size_t  valid = 0;
+    ValueFlags   chunk_flags[s_chunk];
+    for (std::size_t begin = 0; begin < count; begin += s_chunk) {
+      const std::size_t size  = std::min(s_chunk, count - begin);
+      ValueFlags*       flag  = flags != nullptr ? flags + begin : chunk_flags;
+      std::size_t       nan = 0, infinite = 0, negative = 0, subnormal = 0;
+      // The classification has no store dependency, it vectorizes for double from SSE4.1 on which
+      // has 64-bit integer compares
+      for (std::size_t i = 0; i < size; ++i) {
+        flag[i] = classify(column[begin + i]);
+        nan += (flag[i] & ValueFlag::s_nan) != 0;
+        infinite += (flag[i] & ValueFlag::s_infinite) != 0;
+        negative += (flag[i] & ValueFlag::s_negative) != 0;
+        subnormal += (flag[i] & ValueFlag::s_subnormal) != 0;
+      }
+      report.nan += nan;
+      report.infinite += infinite;
+      report.negative += negative;
+      report.subnormal += subnormal;
+      // The compaction always stores and only advances on a valid value
+      if (indices != nullptr && values != nullptr) {
+        for (std::size_t i = 0; i < size; ++i) {
+          indices[valid] = begin + i;
+          values[valid]  = column[begin + i];
+          valid += (flag[i] & m_rejected) == 0;
+        }
+      } else {
+        for (std::size_t i = 0; i < size; ++i) {
+          valid += (flag[i] & m_rejected) == 0;
+        }
+      }
+    }
+    report.valid = valid;
+    return report;
+  }
+
+  /// Write the valid_count results computed on the compacted column back at their indices of out
+  static void scatter(const RawType* results, const std::size_t* indices, std::size_t valid_count, RawType* out) {
+    for (std::size_t i = 0; i < valid_count; ++i) {
+      out[indices[i]] = results[i];
+    }
+  }
+
+  /**
+   * @brief Apply batch(in, count, out) to the valid values only
+   * @details The invalid positions of out receive fill, NaN by default. indices and values are
+   *   scratch space for count elements.
+   */
+  template <typename Batch>
+  ColumnReport apply(Batch&& batch, const RawType* column, std::size_t count, RawType* out, std::size_t* indices,
+                     RawType* values, RawType fill = std::numeric_limits<RawType>::quiet_NaN()) const {
+    const ColumnReport report = sanitize(column, count, nullptr, indices, values);
+    batch(values, report.valid, values);
+    for (std::size_t i = 0; i < count; ++i) {
+      out[i] = fill;
+    }
+    scatter(values, indices, report.valid, out);
+    return report;
+  }
+
+  ValueFlags getRejected() const {
+    return m_rejected;
+  }
+
+private:
+  /// Values classified before being compacted, so that the flags stay in L1
+  static constexpr std::size_t s_chunk = 1024;
+
+  ValueFlags m_rejected;
+};
+
+}  // namespace PhysicsUtils
+}  // namespace Euclid
+#endif /* PHYSICSUTILS_PHYSICSUTILS_COLUMNSANITIZER_H_ */
@@ -0,0 +1,298 @@
+/*
+ * Copyright (C) 2012-2021 Euclid Science Ground Segment
+ *
+ * This library is free software; you can redistribute it and/or modify it under
+ * the terms of the GNU Lesser General Public License as published by the Free
+ * Software Foundation; either version 3.0 of the License, or (at your option)
+ * any later version.
+ *
+ * This library is distributed in the hope that it will be useful, but WITHOUT
+ * ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS
+ * FOR A PARTICULAR PURPOSE. See the GNU Lesser General Public License for more
+ * details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with this library; if not, write to the Free Software Foundation, Inc.,
+ * 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA
+ */
+
+#ifndef PHYSICSUTILS_PHYSICSUTILS_COMOVINGDISTANCETABLE_H_
+#define PHYSICSUTILS_PHYSICSUTILS_COMOVINGDISTANCETABLE_H_
+
+#include "CosmologicalDistances.h"
+#include "CosmologicalParameters.h"
+#include "KernelMode.h"
+#include "Tracing.h"
+#include <algorithm>
+#include <atomic>
+#include <cmath>
+#include <cstddef>
+#include <cstdint>
+#include <istream>
+#include <memory>
+#include <ostream>
+#include <stdexcept>
+#include <vector>
+
+namespace Euclid {
+namespace PhysicsUtils {
+
+/**
+ * @class ComovingDistanceTable
+ *
+ * @brief The comoving distance of one cosmology tabulated on a regular redshift grid
+ *
+ * @details The nodes span [0, z_max] and are computed once with the batch API of
+ *   CosmologicalDistances. Lookups interpolate linearly between the two enclosing nodes; redshifts
+ *   beyond z_max are extrapolated from the last interval.
+ */
+class ComovingDistanceTable {
+public:
+  /**
+   * @brief Tabulate the Romberg comoving distance converged to relative_precision at size nodes
+   * @throws std::invalid_argument if checkGeometry() rejects z_max and size
+   */
+  ComovingDistanceTable(const CosmologicalDistances& distances, const CosmologicalParameters& parameters,
+                        double z_max = 10., std::size_t size = 4096, double relative_precision = 0.0000001)
+    : m_parameters{parameters}
+    , m_z_max{z_max}
+    , m_step{z_max / static_cast<double>(checkGeometry(z_max, size) - 1)}
+    , m_values(size) {
+    PHYSICSUTILS_TRACE_SCOPE("ComovingDistanceTable build", "table");
+    m_inverse_step = 1. / m_step;
+    fillNodes(distances, 0, size, relative_precision);
+  }
+
+  /**
+   * @brief The table of the constructor, built s_build_block nodes at a time and abandoned between
+   *   two blocks once stop is set, for a build that its owner may have to cancel
+   * @return the same table as the constructor, or nullptr if stop was set before it was complete
+   * @throws std::invalid_argument if checkGeometry() rejects z_max and size
+   */
+  static std::unique_ptr<ComovingDistanceTable> build(const CosmologicalDistances&  distances,
+                                                      const CosmologicalParameters& parameters, double z_max,
+                                                      std::size_t size, double relative_precision,
+                                                      const std::atomic<bool>& stop) {
+    PHYSICSUTILS_TRACE_SCOPE("ComovingDistanceTable build", "table");
+    std::unique_ptr<ComovingDistanceTable> table{
+        new ComovingDistanceTable{parameters, z_max, checkGeometry(z_max, size)}};
+    for (std::size_t begin = 0; begin < size; begin += s_build_block) {
+      if (stop.load(std::memory_order_relaxed)) {
+        return nullptr;
+      }
+      table->fillNodes(distances, begin, std::min(s_build_block, size - begin), relative_precision);
+    }
+    return table;
+  }
+
+  double operator()(double z) const {
+    return interpolate<KernelMode::Fast>(z);
+  }
+
+  template <KernelMode mode>
+  double interpolate(double z) const {
+    const double      position = z * m_inverse_step;
+    const std::size_t index    = nodeIndex(position);
+    // The reproducible t is the exactly rounded z / step - index, whether or not FMA is available
+    const double t = mode == KernelMode::Reproducible ? std::fma(z, m_inverse_step, -static_cast<double>(index))
+                                                      : position - static_cast<double>(index);
+    return lerp<mode>(m_values[index], m_values[index + 1], t);
+  }
+
+  /// Interpolate the count redshifts of z into out, which may alias z
+  void operator()(const double* z, std::size_t count, double* out, KernelMode mode = KernelMode::Fast) const {
+    if (mode == KernelMode::Reproducible) {
+      for (std::size_t i = 0; i < count; ++i) {
+        out[i] = interpolate<KernelMode::Reproducible>(z[i]);
+      }
+    } else {
+      for (std::size_t i = 0; i < count; ++i) {
+        out[i] = interpolate<KernelMode::Fast>(z[i]);
+      }
+    }
+  }
+
+  /**
+   * @brief Batch lookup for redshifts in random order, in groups of s_gather_group
+   * @details The node indices and weights of the next group are computed and its nodes prefetched
+   *   before the current group is interpolated, so that the misses of a table larger than the
+   *   caches overlap with useful work instead of stalling the lookups. The interpolation loop only
+   *   has independent loads, which the compiler may turn into gathers. Same results as operator()
+   *   in the same mode. For a table that fits in L2 the prefetches are pure overhead and operator()
+   *   is faster.
+   */
+  void gather(const double* z, std::size_t count, double* out, KernelMode mode = KernelMode::Fast) const {
+    if (mode == KernelMode::Reproducible) {
+      gatherGroups<KernelMode::Reproducible>(z, count, out);
+    } else {
+      gatherGroups<KernelMode::Fast>(z, count, out);
+    }
+  }
+
+  const CosmologicalParameters& getParameters() const {
+    return m_parameters;
+  }
+
+  double getZMax() const {
+    return m_z_max;
+  }
+
+  double getStep() const {
+    return m_step;
+  }
+
+  std::size_t size() const {
+    return m_values.size();
+  }
+
+  const double* data() const {
+    return m_values.data();
+  }
+
+  /// Bytes owned by the table, including its heap storage
+  std::size_t memoryUsage() const {
+    return sizeof(*this) + m_values.capacity() * sizeof(double);
+  }
+
+  /// Write the table in a raw native-endian binary form, to be read back by load()
+  void save(std::ostream& out) const {
+    const double        header[] = {m_parameters.getOmegaM(), m_parameters.getOmegaLambda(),
+                                    m_parameters.getHubbleConstant(), m_z_max};
+    const std::uint64_t size     = m_values.size();
+    out.write(reinterpret_cast<const char*>(&s_magic), sizeof(s_magic));
+    out.write(reinterpret_cast<const char*>(header), sizeof(header));
+    out.write(reinterpret_cast<const char*>(&size), sizeof(size));
+    out.write(reinterpret_cast<const char*>(m_values.data()), static_cast<std::streamsize>(size * sizeof(double)));
+  }
+
+  /**
+   * @brief Read a table written by save(), skipping its computation
+   * @details The header is checked before anything is allocated: z_max must be finite and positive,
+   *   the size at most s_max_load_size and, for a seekable stream, no more than what remains in it.
+   * @throws std::runtime_error if the stream is not a table or is truncated
+   */
+  static ComovingDistanceTable load(std::istream& in) {
+    PHYSICSUTILS_TRACE_SCOPE("ComovingDistanceTable load", "table");
+    std::uint64_t magic = 0;
+    double        header[4];
+    std::uint64_t size = 0;
+    in.read(reinterpret_cast<char*>(&magic), sizeof(magic));
+    in.read(reinterpret_cast<char*>(header), sizeof(header));
+    in.read(reinterpret_cast<char*>(&size), sizeof(size));
+    if (!in || magic != s_magic || size < 2 || size > s_max_load_size || !std::isfinite(header[3]) ||
+        !(header[3] > 0.)) {
+      throw std::runtime_error("ComovingDistanceTable: invalid table stream");
+    }
+    const std::streampos here = in.tellg();
+    if (here != std::streampos(-1)) {
+      in.seekg(0, std::ios::end);
+      const std::streamoff remaining = in.tellg() - here;
+      in.seekg(here);
+      if (!in || remaining < static_cast<std::streamoff>(size * sizeof(double))) {
+        throw std::runtime_error("ComovingDistanceTable: truncated table stream");
+      }
+    }
+    ComovingDistanceTable table{CosmologicalParameters{header[0], header[1], header[2]}, header[3],
+                                static_cast<std::size_t>(size)};
+    in.read(reinterpret_cast<char*>(table.m_values.data()), static_cast<std::streamsize>(size * sizeof(double)));
+    if (!in) {
+      throw std::runtime_error("ComovingDistanceTable: truncated table stream");
+    }
+    return table;
+  }
+
+  /**
+   * @brief Check the grid of a table and return its size
+   * @throws std::invalid_argument unless size >= 2 and z_max is finite and positive
+   */
+  static std::size_t checkGeometry(double z_max, std::size_t size) {
+    if (size < 2) {
+      throw std::invalid_argument("ComovingDistanceTable: a table needs at least 2 nodes");
+    }
+    if (!std::isfinite(z_max) || !(z_max > 0.)) {
+      throw std::invalid_argument("ComovingDistanceTable: z_max must be finite and positive");
+    }
+    return size;
+  }
+
+  /// Queries in flight in gather(), about the number of outstanding misses a core can track
+  static constexpr std::size_t s_gather_group = 16;
+
+  /// Nodes computed between two checks of the stop flag of build()
+  static constexpr std::size_t s_build_block = 256;
+
+  /// Largest table load() accepts, 2 GiB of nodes
+  static constexpr std::uint64_t s_max_load_size = std::uint64_t{1} << 28;
+
+private:
+  static constexpr std::uint64_t s_magic = 0x3130544443505545ULL;  // "EUPCDT01"
+
+  /// The loop of gather() under mode
+  template <KernelMode mode>
+  void gatherGroups(const double* z, std::size_t count, double* out) const {
+    std::size_t index[2][s_gather_group];
+    double      t[2][s_gather_group];
+    std::size_t current = 0;
+    prepareGroup<mode>(z, std::min(s_gather_group, count), index[current], t[current]);
+    for (std::size_t begin = 0; begin < count; begin += s_gather_group) {
+      const std::size_t group = std::min(s_gather_group, count - begin);
+      const std::size_t next  = begin + group;
+      if (next < count) {
+        prepareGroup<mode>(z + next, std::min(s_gather_group, count - next), index[1 - current], t[1 - current]);
+      }
+      for (std::size_t i = 0; i < group; ++i) {
+        const std::size_t node = index[current][i];
+        out[begin + i]         = lerp<mode>(m_values[node], m_values[node + 1], t[current][i]);
+      }
+      current = 1 - current;
+    }
+  }
+
+  /// First node of the interval of position = z / step, clamped in double so that NaN goes to 0 and huge z to the last
+  std::size_t nodeIndex(double position) const {
+    const double last = static_cast<double>(m_values.size() - 2);
+    return static_cast<std::size_t>(position > 0. ? std::min(position, last) : 0.);
+  }
+
+  /// Nodes and weights of a group of gather(), whose nodes are prefetched
+  template <KernelMode mode>
+  void prepareGroup(const double* z, std::size_t group, std::size_t* index, double* t) const {
+    for (std::size_t i = 0; i < group; ++i) {
+      const double position = z[i] * m_inverse_step;
+      index[i]              = nodeIndex(position);
+      t[i] = mode == KernelMode::Reproducible ? std::fma(z[i], m_inverse_step, -static_cast<double>(index[i]))
+                                              : position - static_cast<double>(index[i]);
+    }
+    for (std::size_t i = 0; i < group; ++i) {
+      __builtin_prefetch(m_values.data() + index[i]);
+    }
+  }
+
+  /// Compute the count nodes from first on, node i being at z = i step
+  void fillNodes(const CosmologicalDistances& distances, std::size_t first, std::size_t count,
+                 double relative_precision) {
+    std::vector<double> z(count);
+    for (std::size_t i = 0; i < count; ++i) {
+      z[i] = static_cast<double>(first + i) * m_step;
+    }
+    distances.comovingDistance(z.data(), count, m_values.data() + first, m_parameters, relative_precision);
+  }
+
+  /// Empty table of the given geometry, to be filled by load() or build()
+  ComovingDistanceTable(const CosmologicalParameters& parameters, double z_max, std::size_t size)
+    : m_parameters{parameters}
+    , m_z_max{z_max}
+    , m_step{z_max / static_cast<double>(size - 1)}
+    , m_inverse_step{1. / m_step}
+    , m_values(size) {}
+
+  CosmologicalParameters m_parameters;
+  double                 m_z_max;
+  double                 m_step;
+  double                 m_inverse_step;
+  std::vector<double>    m_values;
+};
+
+}  // namespace PhysicsUtils
+}  // namespace Euclid
+#endif /* PHYSICSUTILS_PHYSICSUTILS_COMOVINGDISTANCETABLE_H_ */
@@ -0,0 +1,305 @@
+/*
+ * Copyright (C) 2012-2021 Euclid Science Ground Segment
+ *
+ * This library is free software; you can redistribute it and/or modify it under
+ * the terms of the GNU Lesser General Public License as published by the Free
+ * Software Foundation; either version 3.0 of the License, or (at your option)
+ * any later version.
+ *
+ * This library is distributed in the hope that it will be useful, but WITHOUT
+ * ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS
+ * FOR A PARTICULAR PURPOSE. See the GNU Lesser General Public License for more
+ * details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with this library; if not, write to the Free Software Foundation, Inc.,
+ * 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA
+ */
+
+#ifndef PHYSICSUTILS_PHYSICSUTILS_COMOVINGKDTREE_H_
+#define PHYSICSUTILS_PHYSICSUTILS_COMOVINGKDTREE_H_
+
+#include "ComovingPositions.h"
+#include "Executor.h"
+#include "Tracing.h"
+#include <algorithm>
+#include <cassert>
+#include <cstddef>
+#include <cstdint>
+#include <functional>
+#include <limits>
+#include <numeric>
+#include <queue>
+#include <utility>
+#include <vector>
+
+namespace Euclid {
+namespace PhysicsUtils {
+
+/**
+ * @class ComovingKdTree
+ *
+ * @brief Spatial index over comoving positions, for radius, k nearest neighbours and
+ *   friends-of-friends queries
+ *
+ * @details The tree is complete and implicit: node i has children 2i + 1 and 2i + 2, every leaf
+ *   is at the same depth and holds at most s_leaf_size points, and each node splits its range at
+ *   the middle index along the widest side of its bounding box. The points are copied in tree
+ *   order, so a leaf is a contiguous run of positions and a subtree a contiguous range, and the
+ *   nodes are a flat array with no pointer.
+ *
+ *   The construction partitions the positions, paired with their indices, with std::nth_element,
+ *   the two subtrees of each of the first levels being built as two tasks of the executor: they
+ *   work on disjoint ranges of the points and of the nodes.
+ *
+ *   The queries return the indices of the positions given to the constructor, the distances are
+ *   in comoving Mpc.
+ */
+class ComovingKdTree {
+public:
+  static constexpr std::size_t s_leaf_size = 16;
+
+  explicit ComovingKdTree(std::vector<Position> positions, Executor& executor = defaultExecutor())
+    : m_points(std::move(positions)), m_index(m_points.size()) {
+    build(executor);
+  }
+
+  /// Build with a pool of thread_count threads of its own, stopped once the tree is built
+  ComovingKdTree(std::vector<Position> positions, std::size_t thread_count)
+    : m_points(std::move(positions)), m_index(m_points.size()) {
+    ThreadPoolExecutor executor{thread_count};
+    build(executor);
+  }
+
+  std::size_t size() const {
+    return m_points.size();
+  }
+
+  std::size_t depth() const {
+    return m_depth;
+  }
+
+  /// Call visitor(index, squared distance) for every position within radius of center
+  template <typename Visitor>
+  void forEachWithin(const Position& center, double radius, Visitor&& visitor) const {
+    if (m_points.empty()) {
+      return;
+    }
+    const double radius2 = radius * radius;
+    std::size_t  stack[64];
+    std::size_t  top = 0;
+    stack[top++]     = 0;
+    while (top > 0) {
+      const std::size_t node = stack[--top];
+      const Node&       n    = m_nodes[node];
+      if (boxDistance(n, center) > radius2) {
+        continue;
+      }
+      if (isLeaf(node)) {
+        for (std::size_t i = n.begin; i < n.end; ++i) {
+          const double d2 = squaredDistance(m_points[i], center);
+          if (d2 <= radius2) {
+            visitor(m_index[i], d2);
+          }
+        }
+        continue;
+      }
+      stack[top++] = 2 * node + 2;
+      stack[top++] = 2 * node + 1;
+    }
+  }
+
+  /// Indices of the positions within radius of center, in no particular order
+  std::vector<std::size_t> radiusQuery(const Position& center, double radius) const {
+    std::vector<std::size_t> result;
+    forEachWithin(center, radius, [&result](std::size_t index, double) { result.push_back(index); });
+    return result;
+  }
+
+  /// The k nearest positions of center as (distance, index) pairs, the nearest first
+  std::vector<std::pair<double, std::size_t>> nearest(const Position& center, std::size_t k) const {
+    std::priority_queue<std::pair<double, std::size_t>> best;
+    if (k > 0 && !m_points.empty()) {
+      nearest(0, center, k, best);
+    }
+    std::vector<std::pair<double, std::size_t>> result(best.size());
+    for (std::size_t i = result.size(); i > 0; --i) {
+      result[i - 1] = {std::sqrt(best.top().first), best.top().second};
+      best.pop();
+    }
+    return result;
+  }
+
+  /**
+   * @brief Friends-of-friends groups for the linking length, in Mpc
+   * @details Returns a group number per position, the groups being numbered from 0 in the order of
+   *   their first member. Each position is linked to its neighbours with a union-find, a
+   *   neighbour already in the same group costing no union.
+   */
+  std::vector<std::size_t> friendsOfFriends(double linking_length) const {
+    PHYSICSUTILS_TRACE_SCOPE("ComovingKdTree friendsOfFriends", "spatial");
+    const std::size_t        count = m_points.size();
+    std::vector<std::size_t> parent(count);
+    std::iota(parent.begin(), parent.end(), 0);
+    const auto find = [&parent](std::size_t i) {
+      while (parent[i] != i) {
+        parent[i] = parent[parent[i]];
+        i         = parent[i];
+      }
+      return i;
+    };
+    // Walk the points in tree order, their neighbours then being mostly in cache
+    for (std::size_t i = 0; i < count; ++i) {
+      const std::size_t self = m_index[i];
+      forEachWithin(m_points[i], linking_length, [&](std::size_t other, double) {
+        if (other > self) {
+          const std::size_t a = find(self), b = find(other);
+          if (a != b) {
+            parent[std::max(a, b)] = std::min(a, b);
+          }
+        }
+      });
+    }
+    std::vector<std::size_t> group(count);
+    std::vector<std::size_t> label(count, std::numeric_limits<std::size_t>::max());
+    std::size_t              groups = 0;
+    for (std::size_t i = 0; i < count; ++i) {
+      const std::size_t root = find(i);
+      if (label[root] == std::numeric_limits<std::size_t>::max()) {
+        label[root] = groups++;
+      }
+      group[i] = label[root];
+    }
+    return group;
+  }
+
+private:
+  struct Node {
+    Position      lower;
+    Position      upper;
+    std::uint32_t begin{0};
+    std::uint32_t end{0};
+  };
+
+  bool isLeaf(std::size_t node) const {
+    return 2 * node + 1 >= m_nodes.size();
+  }
+
+  /// Squared distance from center to the bounding box of the node
+  static double boxDistance(const Node& node, const Position& center) {
+    double d2 = 0.;
+    for (std::size_t axis = 0; axis < 3; ++axis) {
+      const double below = node.lower[axis] - center[axis];
+      const double above = center[axis] - node.upper[axis];
+      const double gap   = std::max(0., std::max(below, above));
+      d2 += gap * gap;
+    }
+    return d2;
+  }
+
+  /// A position and its index in the constructor input, partitioned together during the build
+  struct Entry {
+    Position    position;
+    std::size_t index;
+  };
+
+  void build(Executor& executor) {
+    PHYSICSUTILS_TRACE_SCOPE("ComovingKdTree build", "spatial");
+    assert(m_points.size() <= std::numeric_limits<std::uint32_t>::max());
+    while ((m_points.size() >> m_depth) > s_leaf_size) {
+      ++m_depth;
+    }
+    m_nodes.resize((std::size_t{2} << m_depth) - 1);
+    std::size_t spawn_depth = 0;
+    while ((std::size_t{1} << spawn_depth) < executor.concurrency() && spawn_depth < m_depth) {
+      ++spawn_depth;
+    }
+    std::vector<Entry> entries(m_points.size());
+    for (std::size_t i = 0; i < entries.size(); ++i) {
+      entries[i] = Entry{m_points[i], i};
+    }
+    build(executor, entries, 0, 0, entries.size(), 0, spawn_depth);
+    for (std::size_t i = 0; i < entries.size(); ++i) {
+      m_points[i] = entries[i].position;
+      m_index[i]  = entries[i].index;
+    }
+  }
+
+  void build(Executor& executor, std::vector<Entry>& entries, std::size_t node, std::size_t begin, std::size_t end,
+             std::size_t level, std::size_t spawn_depth) {
+    Node& n = m_nodes[node];
+    n.begin = static_cast<std::uint32_t>(begin);
+    n.end   = static_cast<std::uint32_t>(end);
+    n.lower.fill(std::numeric_limits<double>::infinity());
+    n.upper.fill(-std::numeric_limits<double>::infinity());
+    for (std::size_t i = begin; i < end; ++i) {
+      for (std::size_t axis = 0; axis < 3; ++axis) {
+        n.lower[axis] = std::min(n.lower[axis], entries[i].position[axis]);
+        n.upper[axis] = std::max(n.upper[axis], entries[i].position[axis]);
+      }
+    }
+    if (level == m_depth) {
+      return;
+    }
+
+    std::size_t axis = 0;
+    for (std::size_t a = 1; a < 3; ++a) {
+      if (n.upper[a] - n.lower[a] > n.upper[axis] - n.lower[axis]) {
+        axis = a;
+      }
+    }
+    const std::size_t middle = begin + (end - begin) / 2;
+    std::nth_element(entries.begin() + begin, entries.begin() + middle, entries.begin() + end,
+                     [axis](const Entry& a, const Entry& b) { return a.position[axis] < b.position[axis]; });
+
+    if (level < spawn_depth) {
+      executor.bulk(2, [&](std::size_t child) {
+        build(executor, entries, 2 * node + 1 + child, child == 0 ? begin : middle, child == 0 ? middle : end,
+              level + 1, spawn_depth);
+      });
+    } else {
+      build(executor, entries, 2 * node + 1, begin, middle, level + 1, spawn_depth);
+      build(executor, entries, 2 * node + 2, middle, end, level + 1, spawn_depth);
+    }
+  }
+
+  void nearest(std::size_t node, const Position& center, std::size_t k,
+               std::priority_queue<std::pair<double, std::size_t>>& best) const {
+    const Node& n = m_nodes[node];
+    if (best.size() == k && boxDistance(n, center) >= best.top().first) {
+      return;
+    }
+    if (isLeaf(node)) {
+      for (std::size_t i = n.begin; i < n.end; ++i) {
+        const double d2 = squaredDistance(m_points[i], center);
+        if (best.size() < k) {
+          best.emplace(d2, m_index[i]);
+        } else if (d2 < best.top().first) {
+          best.pop();
+          best.emplace(d2, m_index[i]);
+        }
+      }
+      return;
+    }
+    // Closest child first, so that the second one is usually pruned
+    const std::size_t left  = 2 * node + 1;
+    const std::size_t right = 2 * node + 2;
+    if (boxDistance(m_nodes[left], center) <= boxDistance(m_nodes[right], center)) {
+      nearest(left, center, k, best);
+      nearest(right, center, k, best);
+    } else {
+      nearest(right, center, k, best);
+      nearest(left, center, k, best);
+    }
+  }
+
+  std::vector<Position>    m_points;
+  /// Index in the constructor input of each point, in tree order
+  std::vector<std::size_t> m_index;
+  std::vector<Node>        m_nodes;
+  std::size_t              m_depth{0};
+};
+
+}  // namespace PhysicsUtils
+}  // namespace Euclid
+#endif /* PHYSICSUTILS_PHYSICSUTILS_COMOVINGKDTREE_H_ */
@@ -0,0 +1,96 @@
+/*
+ * Copyright (C) 2012-2021 Euclid Science Ground Segment
+ *
+ * This library is free software; you can redistribute it and/or modify it under
+ * the terms of the GNU Lesser General Public License as published by the Free
+ * Software Foundation; either version 3.0 of the License, or (at your option)
+ * any later version.
+ *
+ * This library is distributed in the hope that it will be useful, but WITHOUT
+ * ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS
+ * FOR A PARTICULAR PURPOSE. See the GNU Lesser General Public License for more
+ * details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with this library; if not, write to the Free Software Foundation, Inc.,
+ * 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA
+ */
+
+#ifndef PHYSICSUTILS_PHYSICSUTILS_COMOVINGPOSITIONS_H_
+#define PHYSICSUTILS_PHYSICSUTILS_COMOVINGPOSITIONS_H_
+
+#include "CosmologicalDistances.h"
+#include "CosmologicalParameters.h"
+#include "Tracing.h"
+#include <array>
+#include <cmath>
+#include <cstddef>
+#include <vector>
+
+namespace Euclid {
+namespace PhysicsUtils {
+
+/// Comoving Cartesian coordinates in Mpc, x towards RA = 0 and z towards the celestial north pole
+using Position = std::array<double, 3>;
+
+inline double squaredDistance(const Position& a, const Position& b) {
+  const double dx = a[0] - b[0], dy = a[1] - b[1], dz = a[2] - b[2];
+  return dx * dx + dy * dy + dz * dz;
+}
+
+/**
+ * @class ComovingPositions
+ *
+ * @brief Conversion of (RA, Dec, z) catalog columns into comoving Cartesian positions
+ *
+ * @details The radial coordinate is the line of sight comoving distance, computed for the whole
+ *   column with the batch API of CosmologicalDistances, the Romberg integral converged to
+ *   relative_precision, so that the spatial tools do not need a separate pass or an intermediate
+ *   file. The angles are in degrees.
+ */
+class ComovingPositions {
+public:
+  explicit ComovingPositions(const CosmologicalParameters& parameters         = CosmologicalParameters{},
+                             double                        relative_precision = 0.0000001)
+    : m_parameters{parameters}, m_relative_precision{relative_precision} {}
+
+  void operator()(const double* right_ascension, const double* declination, const double* z, std::size_t count,
+                  Position* out) const {
+    PHYSICSUTILS_TRACE_SCOPE("ComovingPositions", "spatial");
+    std::vector<double> distance(count);
+    m_distances.comovingDistance(z, count, distance.data(), m_parameters, m_relative_precision);
+    fromDistance(right_ascension, declination, distance.data(), count, out);
+  }
+
+  std::vector<Position> operator()(const std::vector<double>& right_ascension, const std::vector<double>& declination,
+                                   const std::vector<double>& z) const {
+    std::vector<Position> positions(z.size());
+    (*this)(right_ascension.data(), declination.data(), z.data(), z.size(), positions.data());
+    return positions;
+  }
+
+  /// Positions from distances already computed, in Mpc
+  static void fromDistance(const double* right_ascension, const double* declination, const double* distance,
+                           std::size_t count, Position* out) {
+    constexpr double radians_per_degree = 0.017453292519943295;
+    for (std::size_t i = 0; i < count; ++i) {
+      const double alpha = right_ascension[i] * radians_per_degree;
+      const double delta = declination[i] * radians_per_degree;
+      const double rho   = distance[i] * std::cos(delta);
+      out[i]             = Position{rho * std::cos(alpha), rho * std::sin(alpha), distance[i] * std::sin(delta)};
+    }
+  }
+
+  const CosmologicalParameters& getParameters() const {
+    return m_parameters;
+  }
+
+private:
+  CosmologicalParameters m_parameters;
+  double                 m_relative_precision;
+  CosmologicalDistances  m_distances{};
+};
+
+}  // namespace PhysicsUtils
+}  // namespace Euclid
+#endif /* PHYSICSUTILS_PHYSICSUTILS_COMOVINGPOSITIONS_H_ */
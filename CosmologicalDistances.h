@@ -20,12 +20,41 @@
 #define PHYSICSUTILS_PHYSICSUTILS_COSMOLOGICALDISTANCES_H_
 
 #include "CosmologicalParameters.h"
+#include "KernelMode.h"
+#include "Quadrature.h"
 #include "Real.h"
+#include "Tracing.h"
 #include <cassert>
+#include <cmath>
+#include <cstddef>
+#include <stdexcept>
+#include <type_traits>
 
 namespace Euclid {
 namespace PhysicsUtils {
 
+/**
+ * Optional outputs of the batch API for the propagation of redshift errors. derivative receives
+ * dD/dz, sigma the linear propagation |dD/dz| sigma_z of the per-object sigma_z column. Null
+ * pointers are skipped, but sigma needs sigma_z.
+ */
+struct DistanceErrors {
+  double*       derivative{nullptr};
+  const double* sigma_z{nullptr};
+  double*       sigma{nullptr};
+
+  /// Whether any column is written, the plain batch API passes none
+  bool requested() const {
+    return derivative != nullptr || sigma != nullptr;
+  }
+
+  /// The same columns from element begin on, for the chunks of a parallel loop
+  DistanceErrors offset(std::size_t begin) const {
+    return DistanceErrors{derivative != nullptr ? derivative + begin : nullptr,
+                          sigma_z != nullptr ? sigma_z + begin : nullptr, sigma != nullptr ? sigma + begin : nullptr};
+  }
+};
+
 /**
  * @class CosmologicalDistance
  *
@@ -33,13 +62,57 @@ namespace PhysicsUtils {
  */
 class CosmologicalDistances {
 public:
+  /// Speed of light in km/s
+  static constexpr double s_speed_of_light = 299792.458;
+
+  /// Terms of the curvature series of transverseRatio() and transverseSlope()
+  static constexpr std::size_t s_curvature_terms = 6;
+
+  /// 1 / (2n + 1)! for n < s_curvature_terms, the coefficients of S(x)
+  static constexpr double s_transverse_series[s_curvature_terms] = {1.,         1. / 6.,      1. / 120.,
+                                                                    1. / 5040., 1. / 362880., 1. / 39916800.};
+  /// (2 s_curvature_terms + 1)!, the first omitted term of S(x) being x^s_curvature_terms over it
+  static constexpr double s_transverse_next_factorial = 6227020800.;
+
+  /// 1 / (2n)! for n < s_curvature_terms, the coefficients of C(x)
+  static constexpr double s_slope_series[s_curvature_terms] = {1.,        1. / 2.,     1. / 24.,
+                                                               1. / 720., 1. / 40320., 1. / 3628800.};
+  /// (2 s_curvature_terms)!, the first omitted term of C(x) being x^s_curvature_terms over it
+  static constexpr double s_slope_next_factorial = 479001600.;
+
+  /// The Hubble distance c / H0 in Mpc
+  double hubbleDistance(const CosmologicalParameters& parameters) const {
+    return s_speed_of_light / parameters.getHubbleConstant();
+  }
+
+  /// E(z) = H(z) / H0, the inverse of the comoving distance integrand in units of the Hubble distance
+  template <KernelMode mode = KernelMode::Fast>
+  double hubbleParameter(double z, const CosmologicalParameters& parameters) const {
+    const double x = 1. + z;
+    return std::sqrt(multiplyAdd<mode>(multiplyAdd<mode>(parameters.getOmegaM(), x, parameters.getOmegaK()) * x, x,
+                                       parameters.getOmegaLambda()));
+  }
+
+  /// The comoving distance integral converged to relative_precision, see the Criterion overload
   double comovingDistance(double z, const CosmologicalParameters& parameters,
                           double relative_precision = 0.0000001) const {
-    if (Elements::isEqual(0., z)) {
-      return 0.;
-    }
-    assert(z != 0);
-    return 123.;
+    return comovingDistance(z, parameters, QuadratureConvergence<>{relative_precision});
+  }
+
+  /**
+   * @brief The comoving distance integral, refined by the Romberg engine until converged holds
+   * @details converged is one of the criteria of Quadrature.h, e.g. QuadratureConvergence<>{1e-12}
+   *   which also stops once successive estimates are within DBL_DEFAULT_MAX_ULPS of each other.
+   *   mode is the floating point contract of the integrand and of the engine, see KernelMode. Being
+   *   called once per object, it is not traced: the batch entry points that loop over it are.
+   */
+  template <KernelMode mode = KernelMode::Fast, typename Criterion,
+            typename = std::enable_if_t<!std::is_arithmetic<Criterion>::value>>
+  double comovingDistance(double z, const CosmologicalParameters& parameters, const Criterion& converged) const {
+    const auto integrand = [this, &parameters](double x) {
+      return 1. / hubbleParameter<mode>(x, parameters);
+    };
+    return hubbleDistance(parameters) * rombergIntegral<mode>(integrand, 0., z, converged).value;
   }
 
   double transverseComovingDistance(double z, const CosmologicalParameters& parameters) const {
@@ -54,6 +127,228 @@ public:
 
     return 55.;
   }
+
+  /**
+   * @brief S(x) = D_M / D_C as a function of x = Omega_k (D_C / D_H)^2
+   * @details S(x) = sinh(sqrt(x)) / sqrt(x) for open and sin(sqrt(-x)) / sqrt(-x) for closed
+   *   universes. Both are the same series S(x) = sum x^n / (2n + 1)!, which is used up to
+   *   x^s_curvature_terms - 1 whenever the first omitted term is below relative_precision. Flat and
+   *   nearly flat cosmologies, such as those whose Omega_k is the rounding error of
+   *   1 - Omega_m - Omega_Lambda, then share a single polynomial with no branch on the sign or the
+   *   exact zero of Omega_k and no cancellation. The Horner steps are multiply-adds under mode.
+   *   Every transverse distance of the library, DistanceMatrix and FixedCosmologyDistances
+   *   included, goes through this function or its interval form in CertifiedDistances.
+   */
+  template <KernelMode mode = KernelMode::Fast>
+  static double transverseRatio(double x, double relative_precision = 0.0000001) {
+    const double x2 = x * x;
+    if (x2 * x2 * x2 <= relative_precision * s_transverse_next_factorial) {
+      return curvatureSeries<mode>(s_transverse_series, x);
+    }
+    const double root = std::sqrt(std::abs(x));
+    return (x > 0. ? std::sinh(root) : std::sin(root)) / root;
+  }
+
+  /**
+   * @brief C(x) = dD_M / dD_C as a function of x = Omega_k (D_C / D_H)^2
+   * @details C(x) = cosh(sqrt(x)) for open and cos(sqrt(-x)) for closed universes, the series
+   *   C(x) = sum x^n / (2n)!, evaluated as in transverseRatio().
+   */
+  template <KernelMode mode = KernelMode::Fast>
+  static double transverseSlope(double x, double relative_precision = 0.0000001) {
+    const double x2 = x * x;
+    if (x2 * x2 * x2 <= relative_precision * s_slope_next_factorial) {
+      return curvatureSeries<mode>(s_slope_series, x);
+    }
+    const double root = std::sqrt(std::abs(x));
+    return x > 0. ? std::cosh(root) : std::cos(root);
+  }
+
+  /// x = Omega_k (D_C / D_H)^2, the argument of transverseRatio() and transverseSlope()
+  double curvatureArgument(double comoving, const CosmologicalParameters& parameters) const {
+    const double ratio = comoving / hubbleDistance(parameters);
+    return parameters.getOmegaK() * ratio * ratio;
+  }
+
+  /// The transverse comoving distance D_M = D_C S(x) for the comoving distance D_C, see transverseRatio()
+  template <KernelMode mode = KernelMode::Fast>
+  double transverseFromComoving(double comoving, const CosmologicalParameters& parameters,
+                                double relative_precision = 0.0000001) const {
+    return comoving * transverseRatio<mode>(curvatureArgument(comoving, parameters), relative_precision);
+  }
+
+  /// dD_M / dD_C for the comoving distance D_C, see transverseSlope()
+  template <KernelMode mode = KernelMode::Fast>
+  double transverseDerivative(double comoving, const CosmologicalParameters& parameters,
+                              double relative_precision = 0.0000001) const {
+    return transverseSlope<mode>(curvatureArgument(comoving, parameters), relative_precision);
+  }
+
+  /// D_M from the converged comoving distance integral, see transverseFromComoving()
+  template <KernelMode mode = KernelMode::Fast, typename Criterion,
+            typename = std::enable_if_t<!std::is_arithmetic<Criterion>::value>>
+  double transverseComovingDistance(double z, const CosmologicalParameters& parameters, const Criterion& converged,
+                                    double relative_precision = 0.0000001) const {
+    return transverseFromComoving<mode>(comovingDistance<mode>(z, parameters, converged), parameters,
+                                        relative_precision);
+  }
+
+  double luminosityDistance(double z, const CosmologicalParameters& parameters,
+                            double relative_precision = 0.0000001) const {
+    return (1. + z) * transverseComovingDistance(z, parameters, QuadratureConvergence<>{relative_precision},
+                                                 relative_precision);
+  }
+
+  /**
+   * @name Batch API
+   *
+   * Evaluate the distances for the count redshifts in z and write them into out. out must
+   * hold at least count values and may alias z. Each comoving distance is the Romberg integral
+   * converged to relative_precision, D_M and D_L follow from it by transverseFromComoving(). These
+   * run the loops of the overloads with errors below, without any error column.
+   * @{
+   */
+  void comovingDistance(const double* z, std::size_t count, double* out, const CosmologicalParameters& parameters,
+                        double relative_precision = 0.0000001) const {
+    PHYSICSUTILS_TRACE_SCOPE("comovingDistance batch", "quadrature");
+    comovingWithErrors<KernelMode::Fast>(z, count, out, parameters, DistanceErrors{}, relative_precision);
+  }
+
+  void transverseComovingDistance(const double* z, std::size_t count, double* out,
+                                  const CosmologicalParameters& parameters,
+                                  double relative_precision = 0.0000001) const {
+    PHYSICSUTILS_TRACE_SCOPE("transverseComovingDistance batch", "quadrature");
+    transverseWithErrors<KernelMode::Fast>(z, count, out, parameters, DistanceErrors{}, relative_precision);
+  }
+
+  void luminosityDistance(const double* z, std::size_t count, double* out, const CosmologicalParameters& parameters,
+                          double relative_precision = 0.0000001) const {
+    PHYSICSUTILS_TRACE_SCOPE("luminosityDistance batch", "quadrature");
+    luminosityWithErrors<KernelMode::Fast>(z, count, out, parameters, DistanceErrors{}, relative_precision);
+  }
+
+  /**
+   * @brief The batch API with the redshift derivatives and propagated errors of errors
+   * @details The distances come from the Romberg integral converged to relative_precision, the
+   *   same one as the derivatives: dD_C/dz = D_H / E(z), dD_M/dz = dD_C/dz transverseDerivative(D_C)
+   *   and dD_L/dz = D_M + (1 + z) dD_M/dz. D_C is integrated once per object and D_M, D_L and the
+   *   derivatives follow from it in the same loop, all under mode. The outputs of errors may alias
+   *   z and errors.sigma_z.
+   * @throws std::invalid_argument if errors.sigma is given without errors.sigma_z
+   */
+  void comovingDistance(const double* z, std::size_t count, double* out, const CosmologicalParameters& parameters,
+                        const DistanceErrors& errors, double relative_precision = 0.0000001,
+                        KernelMode mode = KernelMode::Fast) const {
+    PHYSICSUTILS_TRACE_SCOPE("comovingDistance batch with errors", "quadrature");
+    checkErrors(errors);
+    if (mode == KernelMode::Reproducible) {
+      comovingWithErrors<KernelMode::Reproducible>(z, count, out, parameters, errors, relative_precision);
+    } else {
+      comovingWithErrors<KernelMode::Fast>(z, count, out, parameters, errors, relative_precision);
+    }
+  }
+
+  void transverseComovingDistance(const double* z, std::size_t count, double* out,
+                                  const CosmologicalParameters& parameters, const DistanceErrors& errors,
+                                  double relative_precision = 0.0000001, KernelMode mode = KernelMode::Fast) const {
+    PHYSICSUTILS_TRACE_SCOPE("transverseComovingDistance batch with errors", "quadrature");
+    checkErrors(errors);
+    if (mode == KernelMode::Reproducible) {
+      transverseWithErrors<KernelMode::Reproducible>(z, count, out, parameters, errors, relative_precision);
+    } else {
+      transverseWithErrors<KernelMode::Fast>(z, count, out, parameters, errors, relative_precision);
+    }
+  }
+
+  void luminosityDistance(const double* z, std::size_t count, double* out, const CosmologicalParameters& parameters,
+                          const DistanceErrors& errors, double relative_precision = 0.0000001,
+                          KernelMode mode = KernelMode::Fast) const {
+    PHYSICSUTILS_TRACE_SCOPE("luminosityDistance batch with errors", "quadrature");
+    checkErrors(errors);
+    if (mode == KernelMode::Reproducible) {
+      luminosityWithErrors<KernelMode::Reproducible>(z, count, out, parameters, errors, relative_precision);
+    } else {
+      luminosityWithErrors<KernelMode::Fast>(z, count, out, parameters, errors, relative_precision);
+    }
+  }
+  /** @} */
+
+private:
+  /// Horner evaluation of the curvature series of the given coefficients
+  template <KernelMode mode>
+  static double curvatureSeries(const double (&coefficients)[s_curvature_terms], double x) {
+    double series = coefficients[s_curvature_terms - 1];
+    for (std::size_t n = s_curvature_terms - 1; n > 0; --n) {
+      series = multiplyAdd<mode>(series, x, coefficients[n - 1]);
+    }
+    return series;
+  }
+
+  static void checkErrors(const DistanceErrors& errors) {
+    if (errors.sigma != nullptr && errors.sigma_z == nullptr) {
+      throw std::invalid_argument("CosmologicalDistances: sigma needs the sigma_z column");
+    }
+  }
+
+  template <KernelMode mode>
+  void comovingWithErrors(const double* z, std::size_t count, double* out, const CosmologicalParameters& parameters,
+                          const DistanceErrors& errors, double relative_precision) const {
+    const QuadratureConvergence<> converged{relative_precision};
+    const double                  hubble_distance = hubbleDistance(parameters);
+    for (std::size_t i = 0; i < count; ++i) {
+      const double redshift = z[i];
+      out[i]                = comovingDistance<mode>(redshift, parameters, converged);
+      if (errors.requested()) {
+        propagate(errors, i, hubble_distance / hubbleParameter<mode>(redshift, parameters));
+      }
+    }
+  }
+
+  template <KernelMode mode>
+  void transverseWithErrors(const double* z, std::size_t count, double* out, const CosmologicalParameters& parameters,
+                            const DistanceErrors& errors, double relative_precision) const {
+    const QuadratureConvergence<> converged{relative_precision};
+    const double                  hubble_distance = hubbleDistance(parameters);
+    for (std::size_t i = 0; i < count; ++i) {
+      const double redshift = z[i];
+      const double comoving = comovingDistance<mode>(redshift, parameters, converged);
+      out[i]                = transverseFromComoving<mode>(comoving, parameters, relative_precision);
+      if (errors.requested()) {
+        const double slope = hubble_distance / hubbleParameter<mode>(redshift, parameters);
+        propagate(errors, i, slope * transverseDerivative<mode>(comoving, parameters, relative_precision));
+      }
+    }
+  }
+
+  template <KernelMode mode>
+  void luminosityWithErrors(const double* z, std::size_t count, double* out, const CosmologicalParameters& parameters,
+                            const DistanceErrors& errors, double relative_precision) const {
+    const QuadratureConvergence<> converged{relative_precision};
+    const double                  hubble_distance = hubbleDistance(parameters);
+    for (std::size_t i = 0; i < count; ++i) {
+      const double redshift   = z[i];
+      const double comoving   = comovingDistance<mode>(redshift, parameters, converged);
+      const double transverse = transverseFromComoving<mode>(comoving, parameters, relative_precision);
+      out[i]                  = (1. + redshift) * transverse;
+      if (errors.requested()) {
+        const double slope = hubble_distance / hubbleParameter<mode>(redshift, parameters);
+        propagate(errors, i,
+                  multiplyAdd<mode>((1. + redshift) * slope,
+                                    transverseDerivative<mode>(comoving, parameters, relative_precision), transverse));
+      }
+    }
+  }
+
+  /// Write the derivative of element i and its propagated error, reading sigma_z before any write
+  static void propagate(const DistanceErrors& errors, std::size_t i, double derivative) {
+    const double sigma_z = errors.sigma != nullptr ? errors.sigma_z[i] : 0.;
+    if (errors.derivative != nullptr) {
+      errors.derivative[i] = derivative;
+    }
+    if (errors.sigma != nullptr) {
+      errors.sigma[i] = std::abs(derivative) * sigma_z;
+    }
+  }
 };
 
 }  // namespace PhysicsUtils
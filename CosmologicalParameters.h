@@ -19,9 +19,29 @@
 #ifndef PHYSICSUTILS_PHYSICSUTILS_COSMOLOGICALPARAMETERS_H_
 #define PHYSICSUTILS_PHYSICSUTILS_COSMOLOGICALPARAMETERS_H_
 
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+#include <functional>
+
 namespace Euclid {
 namespace PhysicsUtils {
 
+namespace Detail {
+
+/// Initial value of mixHash, the FNV-1a 64-bit offset basis
+constexpr std::uint64_t hash_seed = 14695981039346656037ULL;
+
+/// Mix the bit pattern of value into hash: an FNV-1a step on the whole word, then a xor-shift
+inline std::uint64_t mixHash(std::uint64_t hash, double value) {
+  std::uint64_t bits;
+  std::memcpy(&bits, &value, sizeof(bits));
+  hash = (hash ^ bits) * 1099511628211ULL;
+  return hash ^ (hash >> 29);
+}
+
+}  // namespace Detail
+
 class CosmologicalParameters {
 public:
   CosmologicalParameters(double omega_m = 0.3089, double omega_lambda = 0.6911, double hubble_constant = 67.74)
@@ -30,10 +50,30 @@ public:
     , m_omega_k{1.0 - omega_m - omega_lambda}
     , m_H_0{hubble_constant} {}
 
+  double getOmegaM() const {
+    return m_omega_m;
+  }
+
+  double getOmegaLambda() const {
+    return m_omega_lambda;
+  }
+
   double getOmegaK() const {
     return m_omega_k;
   }
 
+  double getHubbleConstant() const {
+    return m_H_0;
+  }
+
+  bool operator==(const CosmologicalParameters& other) const {
+    return m_omega_m == other.m_omega_m && m_omega_lambda == other.m_omega_lambda && m_H_0 == other.m_H_0;
+  }
+
+  bool operator!=(const CosmologicalParameters& other) const {
+    return !(*this == other);
+  }
+
 private:
   double m_omega_m;
   double m_omega_lambda;
@@ -43,4 +83,21 @@ private:
 
 }  // namespace PhysicsUtils
 }  // namespace Euclid
+
+namespace std {
+
+/// Hash of the bit patterns of the parameters, consistent with operator==
+template <>
+struct hash<Euclid::PhysicsUtils::CosmologicalParameters> {
+  std::size_t operator()(const Euclid::PhysicsUtils::CosmologicalParameters& parameters) const {
+    std::uint64_t hash = Euclid::PhysicsUtils::Detail::hash_seed;
+    for (double value : {parameters.getOmegaM(), parameters.getOmegaLambda(), parameters.getHubbleConstant()}) {
+      // -0. and 0. compare equal
+      hash = Euclid::PhysicsUtils::Detail::mixHash(hash, value + 0.);
+    }
+    return static_cast<std::size_t>(hash);
+  }
+};
+
+}  // namespace std
 #endif /* PHYSICSUTILS_PHYSICSUTILS_COSMOLOGICALPARAMETERS_H_ */
@@ -0,0 +1,210 @@
+/*
+ * Copyright (C) 2012-2021 Euclid Science Ground Segment
+ *
+ * This library is free software; you can redistribute it and/or modify it under
+ * the terms of the GNU Lesser General Public License as published by the Free
+ * Software Foundation; either version 3.0 of the License, or (at your option)
+ * any later version.
+ *
+ * This library is distributed in the hope that it will be useful, but WITHOUT
+ * ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS
+ * FOR A PARTICULAR PURPOSE. See the GNU Lesser General Public License for more
+ * details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with this library; if not, write to the Free Software Foundation, Inc.,
+ * 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA
+ */
+
+#ifndef PHYSICSUTILS_PHYSICSUTILS_DISTANCEAGGREGATION_H_
+#define PHYSICSUTILS_PHYSICSUTILS_DISTANCEAGGREGATION_H_
+
+#include <algorithm>
+#include <cmath>
+#include <cstddef>
+#include <limits>
+#include <stdexcept>
+#include <vector>
+
+namespace Euclid {
+namespace PhysicsUtils {
+
+/// The distance of the batch API that an aggregation consumes
+enum class DistanceKind { Comoving, Transverse, Luminosity };
+
+/**
+ * @class DistanceHistogram
+ *
+ * @brief Weighted counts of distances in uniform bins of [lower, upper)
+ *
+ * @details The distances below lower, at or above upper and NaN are summed apart, so that the
+ *   total weight is always accounted for.
+ */
+class DistanceHistogram {
+public:
+  DistanceHistogram(double lower, double upper, std::size_t bins)
+    : m_lower{lower}, m_upper{upper}, m_scale{bins / (upper - lower)}, m_counts(bins, 0.) {
+    if (bins == 0 || !(upper > lower)) {
+      throw std::invalid_argument("DistanceHistogram: needs at least one bin and upper > lower");
+    }
+  }
+
+  void add(double distance, double weight = 1.) {
+    if (distance >= m_lower && distance < m_upper) {
+      const auto bin = static_cast<std::size_t>((distance - m_lower) * m_scale);
+      // Rounding may put a distance just below upper in the one past the last bin
+      m_counts[std::min(bin, m_counts.size() - 1)] += weight;
+    } else if (distance < m_lower) {
+      m_underflow += weight;
+    } else if (distance >= m_upper) {
+      m_overflow += weight;
+    } else {
+      m_nan += weight;
+    }
+  }
+
+  /// Add the counts of a histogram with the same bins
+  void merge(const DistanceHistogram& other) {
+    if (other.m_lower != m_lower || other.m_upper != m_upper || other.m_counts.size() != m_counts.size()) {
+      throw std::invalid_argument("DistanceHistogram: cannot merge histograms with different bins");
+    }
+    for (std::size_t bin = 0; bin < m_counts.size(); ++bin) {
+      m_counts[bin] += other.m_counts[bin];
+    }
+    m_underflow += other.m_underflow;
+    m_overflow += other.m_overflow;
+    m_nan += other.m_nan;
+  }
+
+  const std::vector<double>& getCounts() const {
+    return m_counts;
+  }
+
+  /// Lower edge of bin, upper edge of the last one for bin == bins
+  double getEdge(std::size_t bin) const {
+    return m_lower + (m_upper - m_lower) * static_cast<double>(bin) / static_cast<double>(m_counts.size());
+  }
+
+  double getUnderflow() const {
+    return m_underflow;
+  }
+
+  double getOverflow() const {
+    return m_overflow;
+  }
+
+  double getNan() const {
+    return m_nan;
+  }
+
+private:
+  double              m_lower;
+  double              m_upper;
+  double              m_scale;
+  std::vector<double> m_counts;
+  double              m_underflow{0.};
+  double              m_overflow{0.};
+  double              m_nan{0.};
+};
+
+/**
+ * @class DistanceMoments
+ *
+ * @brief Weighted mean, variance and range of distances in a single pass
+ *
+ * @details The running mean and sum of squared deviations are updated with West's weighted form
+ *   of Welford's algorithm, and two partial results are combined with the pairwise formula of
+ *   Chan, Golub and LeVeque, so that the variance does not suffer from the cancellation of the
+ *   sum of squares at distances of thousands of Mpc. Entries of zero weight and NaN distances are
+ *   counted but do not change the moments, which makes a 0/1 weight column a selection.
+ */
+class DistanceMoments {
+public:
+  void add(double distance, double weight = 1.) {
+    ++m_count;
+    if (weight == 0. || std::isnan(distance)) {
+      return;
+    }
+    const double total = m_weight + weight;
+    const double delta = distance - m_mean;
+    const double shift = delta * weight / total;
+    m_mean += shift;
+    m_squares += m_weight * delta * shift;
+    m_weight = total;
+    m_min    = std::min(m_min, distance);
+    m_max    = std::max(m_max, distance);
+  }
+
+  void merge(const DistanceMoments& other) {
+    m_count += other.m_count;
+    if (other.m_weight == 0.) {
+      return;
+    }
+    const double total = m_weight + other.m_weight;
+    const double delta = other.m_mean - m_mean;
+    m_mean += delta * other.m_weight / total;
+    m_squares += other.m_squares + delta * delta * m_weight * other.m_weight / total;
+    m_weight = total;
+    m_min    = std::min(m_min, other.m_min);
+    m_max    = std::max(m_max, other.m_max);
+  }
+
+  /// Number of entries, of any weight
+  std::size_t getCount() const {
+    return m_count;
+  }
+
+  double getWeight() const {
+    return m_weight;
+  }
+
+  /// Weighted sum of the distances
+  double getSum() const {
+    return m_mean * m_weight;
+  }
+
+  double getMean() const {
+    return m_weight > 0. ? m_mean : std::numeric_limits<double>::quiet_NaN();
+  }
+
+  /// Weighted population variance, sum w (d - mean)^2 / sum w
+  double getVariance() const {
+    return m_weight > 0. ? m_squares / m_weight : std::numeric_limits<double>::quiet_NaN();
+  }
+
+  double getMin() const {
+    return m_min;
+  }
+
+  double getMax() const {
+    return m_max;
+  }
+
+private:
+  std::size_t m_count{0};
+  double      m_weight{0.};
+  double      m_mean{0.};
+  double      m_squares{0.};
+  double      m_min{std::numeric_limits<double>::infinity()};
+  double      m_max{-std::numeric_limits<double>::infinity()};
+};
+
+/// Histogram and moments filled by the same pass
+struct DistanceSummary {
+  DistanceHistogram histogram;
+  DistanceMoments   moments{};
+
+  void add(double distance, double weight = 1.) {
+    histogram.add(distance, weight);
+    moments.add(distance, weight);
+  }
+
+  void merge(const DistanceSummary& other) {
+    histogram.merge(other.histogram);
+    moments.merge(other.moments);
+  }
+};
+
+}  // namespace PhysicsUtils
+}  // namespace Euclid
+#endif /* PHYSICSUTILS_PHYSICSUTILS_DISTANCEAGGREGATION_H_ */
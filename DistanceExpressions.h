@@ -0,0 +1,386 @@
+/*
+ * Copyright (C) 2012-2021 Euclid Science Ground Segment
+ *
+ * This library is free software; you can redistribute it and/or modify it under
+ * the terms of the GNU Lesser General Public License as published by the Free
+ * Software Foundation; either version 3.0 of the License, or (at your option)
+ * any later version.
+ *
+ * This library is distributed in the hope that it will be useful, but WITHOUT
+ * ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS
+ * FOR A PARTICULAR PURPOSE. See the GNU Lesser General Public License for more
+ * details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with this library; if not, write to the Free Software Foundation, Inc.,
+ * 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA
+ */
+
+#ifndef PHYSICSUTILS_PHYSICSUTILS_DISTANCEEXPRESSIONS_H_
+#define PHYSICSUTILS_PHYSICSUTILS_DISTANCEEXPRESSIONS_H_
+
+#include "CosmologicalDistances.h"
+#include "CosmologicalParameters.h"
+#include <algorithm>
+#include <cmath>
+#include <cstddef>
+#include <stdexcept>
+#include <vector>
+
+namespace Euclid {
+namespace PhysicsUtils {
+namespace Expressions {
+
+/**
+ * @class Expression
+ *
+ * @brief Lazy element-wise expression over arrays of redshifts and distances
+ *
+ * @details The arithmetic operators and the math functions of this namespace only build a tree of
+ *   nodes. Nothing is computed until evaluate() is called, which then runs a single loop over the
+ *   elements and computes the whole tree for each of them, without intermediate arrays:
+ *
+ *   @code
+ *   auto mu = 5. * log10(luminosityDistance(distances, parameters, array(z))) + 25. - array(m);
+ *   evaluate(mu, residuals);
+ *   @endcode
+ *
+ *   evaluate() walks the elements by blocks of s_block_size: every node computes a whole block with
+ *   evaluateBlock() before its parent consumes it, so that the distance leaves call the batch API
+ *   of CosmologicalDistances once per block and the intermediate values stay in L1-sized buffers
+ *   on the stack.
+ *
+ *   The nodes keep pointers to the arrays and to the CosmologicalDistances instance, which must
+ *   outlive the evaluation.
+ */
+template <typename Derived>
+class Expression {
+public:
+  /// Elements per evaluateBlock() call, the size of the stack buffers of the nodes
+  static constexpr std::size_t s_block_size = 256;
+
+  const Derived& self() const {
+    return static_cast<const Derived&>(*this);
+  }
+};
+
+/// Leaf reading the elements of an existing array
+class ArrayTerminal : public Expression<ArrayTerminal> {
+public:
+  ArrayTerminal(const double* data, std::size_t size) : m_data{data}, m_size{size} {}
+
+  double operator[](std::size_t i) const {
+    return m_data[i];
+  }
+
+  void evaluateBlock(std::size_t begin, std::size_t count, double* out) const {
+    std::copy(m_data + begin, m_data + begin + count, out);
+  }
+
+  std::size_t size() const {
+    return m_size;
+  }
+
+private:
+  const double* m_data;
+  std::size_t   m_size;
+};
+
+/// Leaf broadcasting a constant to every element. Its size is 0, meaning "any".
+class ScalarTerminal : public Expression<ScalarTerminal> {
+public:
+  explicit ScalarTerminal(double value) : m_value{value} {}
+
+  double operator[](std::size_t) const {
+    return m_value;
+  }
+
+  void evaluateBlock(std::size_t, std::size_t count, double* out) const {
+    std::fill(out, out + count, m_value);
+  }
+
+  std::size_t size() const {
+    return 0;
+  }
+
+private:
+  double m_value;
+};
+
+template <typename Op, typename Operand>
+class UnaryExpression : public Expression<UnaryExpression<Op, Operand>> {
+public:
+  explicit UnaryExpression(const Operand& operand) : m_operand{operand} {}
+
+  double operator[](std::size_t i) const {
+    return Op::apply(m_operand[i]);
+  }
+
+  void evaluateBlock(std::size_t begin, std::size_t count, double* out) const {
+    m_operand.evaluateBlock(begin, count, out);
+    for (std::size_t i = 0; i < count; ++i) {
+      out[i] = Op::apply(out[i]);
+    }
+  }
+
+  std::size_t size() const {
+    return m_operand.size();
+  }
+
+private:
+  Operand m_operand;
+};
+
+template <typename Op, typename Left, typename Right>
+class BinaryExpression : public Expression<BinaryExpression<Op, Left, Right>> {
+public:
+  /// @throws std::invalid_argument if both operands are arrays of different sizes
+  BinaryExpression(const Left& left, const Right& right) : m_left{left}, m_right{right} {
+    if (m_left.size() != 0 && m_right.size() != 0 && m_left.size() != m_right.size()) {
+      throw std::invalid_argument("Expressions: the operands have different sizes");
+    }
+  }
+
+  double operator[](std::size_t i) const {
+    return Op::apply(m_left[i], m_right[i]);
+  }
+
+  void evaluateBlock(std::size_t begin, std::size_t count, double* out) const {
+    double right[Expression<BinaryExpression>::s_block_size];
+    m_left.evaluateBlock(begin, count, out);
+    m_right.evaluateBlock(begin, count, right);
+    for (std::size_t i = 0; i < count; ++i) {
+      out[i] = Op::apply(out[i], right[i]);
+    }
+  }
+
+  std::size_t size() const {
+    return std::max(m_left.size(), m_right.size());
+  }
+
+private:
+  Left  m_left;
+  Right m_right;
+};
+
+/**
+ * @brief Leaf computing a distance of CosmologicalDistances for each redshift of its operand
+ * @details evaluateBlock() computes the redshifts of the block in place and hands them to the batch
+ *   API, operator[] goes through the scalar one.
+ * @tparam Distance
+ *   One of the ComovingDistance, TransverseComovingDistance or LuminosityDistance tags
+ */
+template <typename Distance, typename Redshift>
+class DistanceExpression : public Expression<DistanceExpression<Distance, Redshift>> {
+public:
+  DistanceExpression(const CosmologicalDistances& distances, const CosmologicalParameters& parameters,
+                     const Redshift& z)
+    : m_distances{&distances}, m_parameters{parameters}, m_z{z} {}
+
+  double operator[](std::size_t i) const {
+    return Distance::apply(*m_distances, m_z[i], m_parameters);
+  }
+
+  void evaluateBlock(std::size_t begin, std::size_t count, double* out) const {
+    m_z.evaluateBlock(begin, count, out);
+    Distance::apply(*m_distances, out, count, out, m_parameters);
+  }
+
+  std::size_t size() const {
+    return m_z.size();
+  }
+
+private:
+  const CosmologicalDistances* m_distances;
+  CosmologicalParameters       m_parameters;
+  Redshift                     m_z;
+};
+
+struct ComovingDistance {
+  static double apply(const CosmologicalDistances& distances, double z, const CosmologicalParameters& parameters) {
+    return distances.comovingDistance(z, parameters);
+  }
+
+  static void apply(const CosmologicalDistances& distances, const double* z, std::size_t count, double* out,
+                    const CosmologicalParameters& parameters) {
+    distances.comovingDistance(z, count, out, parameters);
+  }
+};
+
+struct TransverseComovingDistance {
+  static double apply(const CosmologicalDistances& distances, double z, const CosmologicalParameters& parameters) {
+    return distances.transverseComovingDistance(z, parameters);
+  }
+
+  static void apply(const CosmologicalDistances& distances, const double* z, std::size_t count, double* out,
+                    const CosmologicalParameters& parameters) {
+    distances.transverseComovingDistance(z, count, out, parameters);
+  }
+};
+
+struct LuminosityDistance {
+  static double apply(const CosmologicalDistances& distances, double z, const CosmologicalParameters& parameters) {
+    return distances.luminosityDistance(z, parameters);
+  }
+
+  static void apply(const CosmologicalDistances& distances, const double* z, std::size_t count, double* out,
+                    const CosmologicalParameters& parameters) {
+    distances.luminosityDistance(z, count, out, parameters);
+  }
+};
+
+struct Plus {
+  static double apply(double left, double right) {
+    return left + right;
+  }
+};
+
+struct Minus {
+  static double apply(double left, double right) {
+    return left - right;
+  }
+};
+
+struct Multiplies {
+  static double apply(double left, double right) {
+    return left * right;
+  }
+};
+
+struct Divides {
+  static double apply(double left, double right) {
+    return left / right;
+  }
+};
+
+struct Negate {
+  static double apply(double value) {
+    return -value;
+  }
+};
+
+struct Log10 {
+  static double apply(double value) {
+    return std::log10(value);
+  }
+};
+
+struct Log {
+  static double apply(double value) {
+    return std::log(value);
+  }
+};
+
+struct Exp {
+  static double apply(double value) {
+    return std::exp(value);
+  }
+};
+
+struct Sqrt {
+  static double apply(double value) {
+    return std::sqrt(value);
+  }
+};
+
+struct Square {
+  static double apply(double value) {
+    return value * value;
+  }
+};
+
+inline ArrayTerminal array(const double* data, std::size_t size) {
+  return ArrayTerminal{data, size};
+}
+
+inline ArrayTerminal array(const std::vector<double>& values) {
+  return ArrayTerminal{values.data(), values.size()};
+}
+
+template <typename Redshift>
+DistanceExpression<ComovingDistance, Redshift> comovingDistance(const CosmologicalDistances&  distances,
+                                                                const CosmologicalParameters& parameters,
+                                                                const Expression<Redshift>&   z) {
+  return {distances, parameters, z.self()};
+}
+
+template <typename Redshift>
+DistanceExpression<TransverseComovingDistance, Redshift>
+transverseComovingDistance(const CosmologicalDistances& distances, const CosmologicalParameters& parameters,
+                           const Expression<Redshift>& z) {
+  return {distances, parameters, z.self()};
+}
+
+template <typename Redshift>
+DistanceExpression<LuminosityDistance, Redshift> luminosityDistance(const CosmologicalDistances&  distances,
+                                                                    const CosmologicalParameters& parameters,
+                                                                    const Expression<Redshift>&   z) {
+  return {distances, parameters, z.self()};
+}
+
+#define PHYSICSUTILS_EXPRESSION_UNARY_FUNCTION(name, Op)                  \
+  template <typename Operand>                                             \
+  UnaryExpression<Op, Operand> name(const Expression<Operand>& operand) { \
+    return UnaryExpression<Op, Operand>{operand.self()};                  \
+  }
+
+PHYSICSUTILS_EXPRESSION_UNARY_FUNCTION(operator-, Negate)
+PHYSICSUTILS_EXPRESSION_UNARY_FUNCTION(log10, Log10)
+PHYSICSUTILS_EXPRESSION_UNARY_FUNCTION(log, Log)
+PHYSICSUTILS_EXPRESSION_UNARY_FUNCTION(exp, Exp)
+PHYSICSUTILS_EXPRESSION_UNARY_FUNCTION(sqrt, Sqrt)
+PHYSICSUTILS_EXPRESSION_UNARY_FUNCTION(square, Square)
+
+#undef PHYSICSUTILS_EXPRESSION_UNARY_FUNCTION
+
+#define PHYSICSUTILS_EXPRESSION_BINARY_OPERATOR(name, Op)                                                     \
+  template <typename Left, typename Right>                                                                    \
+  BinaryExpression<Op, Left, Right> name(const Expression<Left>& left, const Expression<Right>& right) {      \
+    return BinaryExpression<Op, Left, Right>{left.self(), right.self()};                                      \
+  }                                                                                                           \
+  template <typename Right>                                                                                   \
+  BinaryExpression<Op, ScalarTerminal, Right> name(double left, const Expression<Right>& right) {             \
+    return BinaryExpression<Op, ScalarTerminal, Right>{ScalarTerminal{left}, right.self()};                   \
+  }                                                                                                           \
+  template <typename Left>                                                                                    \
+  BinaryExpression<Op, Left, ScalarTerminal> name(const Expression<Left>& left, double right) {              \
+    return BinaryExpression<Op, Left, ScalarTerminal>{left.self(), ScalarTerminal{right}};                    \
+  }
+
+PHYSICSUTILS_EXPRESSION_BINARY_OPERATOR(operator+, Plus)
+PHYSICSUTILS_EXPRESSION_BINARY_OPERATOR(operator-, Minus)
+PHYSICSUTILS_EXPRESSION_BINARY_OPERATOR(operator*, Multiplies)
+PHYSICSUTILS_EXPRESSION_BINARY_OPERATOR(operator/, Divides)
+
+#undef PHYSICSUTILS_EXPRESSION_BINARY_OPERATOR
+
+/**
+ * @brief Compute the expression in a single pass and write the results into out
+ * @details out must hold expression.size() values. It may alias any array of the expression:
+ *   each element only depends on the elements with the same index, and a block is written to out
+ *   only once all its inputs have been read.
+ */
+template <typename Derived>
+void evaluate(const Expression<Derived>& expression, double* out) {
+  constexpr std::size_t block_size = Expression<Derived>::s_block_size;
+  const Derived&        e          = expression.self();
+  const std::size_t     size       = e.size();
+  double                block[block_size];
+  for (std::size_t begin = 0; begin < size; begin += block_size) {
+    const std::size_t count = std::min(block_size, size - begin);
+    e.evaluateBlock(begin, count, block);
+    std::copy(block, block + count, out + begin);
+  }
+}
+
+template <typename Derived>
+std::vector<double> evaluate(const Expression<Derived>& expression) {
+  std::vector<double> out(expression.self().size());
+  evaluate(expression, out.data());
+  return out;
+}
+
+}  // namespace Expressions
+}  // namespace PhysicsUtils
+}  // namespace Euclid
+#endif /* PHYSICSUTILS_PHYSICSUTILS_DISTANCEEXPRESSIONS_H_ */
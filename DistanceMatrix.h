@@ -0,0 +1,237 @@
+/*
+ * Copyright (C) 2012-2021 Euclid Science Ground Segment
+ *
+ * This library is free software; you can redistribute it and/or modify it under
+ * the terms of the GNU Lesser General Public License as published by the Free
+ * Software Foundation; either version 3.0 of the License, or (at your option)
+ * any later version.
+ *
+ * This library is distributed in the hope that it will be useful, but WITHOUT
+ * ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS
+ * FOR A PARTICULAR PURPOSE. See the GNU Lesser General Public License for more
+ * details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with this library; if not, write to the Free Software Foundation, Inc.,
+ * 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA
+ */
+
+#ifndef PHYSICSUTILS_PHYSICSUTILS_DISTANCEMATRIX_H_
+#define PHYSICSUTILS_PHYSICSUTILS_DISTANCEMATRIX_H_
+
+#include "CosmologicalDistances.h"
+#include "CosmologicalParameters.h"
+#include "KernelMode.h"
+#include "Tracing.h"
+#include <algorithm>
+#include <cmath>
+#include <cstddef>
+#include <limits>
+#include <numeric>
+#include <stdexcept>
+#include <vector>
+
+namespace Euclid {
+namespace PhysicsUtils {
+
+/// Storage order of a (cosmology, redshift) matrix: RowMajor keeps the redshifts of a cosmology contiguous
+enum class MatrixLayout { RowMajor, ColumnMajor };
+
+/// Destination matrices of DistanceMatrix::evaluate, any of them may be null to skip it
+struct DistanceMatrixOutput {
+  /// Comoving distance D_C in Mpc
+  double* comoving{nullptr};
+  /// Transverse comoving distance D_M in Mpc
+  double* transverse{nullptr};
+  /// Hubble parameter H(z) in km/s/Mpc
+  double* hubble{nullptr};
+};
+
+/**
+ * @class DistanceMatrix
+ *
+ * @brief Distances for every pair of a set of cosmologies and a fixed redshift grid
+ *
+ * @details The constructor sorts the redshifts and lays Gauss-Legendre nodes on the panels between
+ *   them, storing (1 + z)^2, (1 + z)^3 and the weights once for all the cosmologies.
+ *   evaluate() then walks the matrix by tiles: a tile of cosmologies times a tile of redshifts
+ *   whose nodes fit in L1. The node powers of a redshift tile are reused by every cosmology of the
+ *   tile, and the per-cosmology constants and running integrals stay in registers or L1. The
+ *   inner loop over the nodes of a panel has no branch and vectorizes.
+ *
+ *   The redshifts must be finite and non-negative. They do not need to be sorted or unique.
+ *   The constructor throws std::invalid_argument for a redshift that is not, a panel width that
+ *   is not finite and positive or a tile of zero cosmologies or nodes.
+ */
+class DistanceMatrix {
+public:
+  static constexpr std::size_t s_nodes_per_panel = 4;
+
+  DistanceMatrix(const double* z, std::size_t count, double max_panel_width = 1. / 16,
+                 std::size_t cosmology_tile = 32, std::size_t node_tile = 512)
+    : m_order(count), m_cosmology_tile{cosmology_tile}, m_node_tile{node_tile} {
+    if (!std::isfinite(max_panel_width) || !(max_panel_width > 0.) || cosmology_tile == 0 || node_tile == 0) {
+      throw std::invalid_argument("DistanceMatrix: the panel width and the tiles must be positive");
+    }
+    // Checked before the sort, whose comparison is not a strict weak order with NaN
+    for (std::size_t i = 0; i < count; ++i) {
+      if (!std::isfinite(z[i]) || z[i] < 0.) {
+        throw std::invalid_argument("DistanceMatrix: the redshifts must be finite and non-negative");
+      }
+    }
+    // Gauss-Legendre 4 points on [-1, 1]
+    static constexpr double abscissas[s_nodes_per_panel] = {-0.86113631159405257522, -0.33998104358485626480,
+                                                            0.33998104358485626480, 0.86113631159405257522};
+    static constexpr double weights[s_nodes_per_panel]   = {0.34785484513745385737, 0.65214515486254614263,
+                                                          0.65214515486254614263, 0.34785484513745385737};
+
+    std::iota(m_order.begin(), m_order.end(), 0);
+    std::sort(m_order.begin(), m_order.end(), [z](std::size_t i, std::size_t j) { return z[i] < z[j]; });
+    m_end.reserve(count);
+    m_x.reserve(count);
+    double previous = 0.;
+    for (std::size_t index : m_order) {
+      const double      interval = z[index] - previous;
+      const std::size_t panels =
+          interval > 0. ? static_cast<std::size_t>(std::ceil(interval / max_panel_width)) : 0;
+      const double      width = panels > 0 ? interval / static_cast<double>(panels) : 0.;
+      for (std::size_t p = 0; p < panels; ++p) {
+        // Explicit FMAs, so that the nodes shared by both KernelModes are the same on every target
+        const double center = std::fma(static_cast<double>(p) + 0.5, width, previous);
+        for (std::size_t n = 0; n < s_nodes_per_panel; ++n) {
+          const double x = std::fma(0.5 * width, abscissas[n], 1. + center);
+          m_node_x2.push_back(x * x);
+          m_node_x3.push_back(x * x * x);
+          m_node_weight.push_back(0.5 * width * weights[n]);
+        }
+      }
+      m_end.push_back(m_node_weight.size());
+      m_x.push_back(1. + z[index]);
+      previous = z[index];
+    }
+  }
+
+  std::size_t redshiftCount() const {
+    return m_order.size();
+  }
+
+  std::size_t nodeCount() const {
+    return m_node_weight.size();
+  }
+
+  /**
+   * @brief Fill the requested matrices for the count cosmologies
+   * @details Each output holds count * redshiftCount() values in the given layout, the redshifts
+   *   being in the order given to the constructor. In the Reproducible mode the integrand and
+   *   H(z) are evaluated with explicit multiply-adds, see KernelMode.
+   */
+  void evaluate(const CosmologicalParameters* parameters, std::size_t count, const DistanceMatrixOutput& output,
+                MatrixLayout layout = MatrixLayout::RowMajor, KernelMode mode = KernelMode::Fast) const {
+    PHYSICSUTILS_TRACE_SCOPE("DistanceMatrix evaluate", "quadrature");
+    if (mode == KernelMode::Reproducible) {
+      evaluateTiles<KernelMode::Reproducible>(parameters, count, output, layout);
+    } else {
+      evaluateTiles<KernelMode::Fast>(parameters, count, output, layout);
+    }
+  }
+
+  void evaluate(const std::vector<CosmologicalParameters>& parameters, const DistanceMatrixOutput& output,
+                MatrixLayout layout = MatrixLayout::RowMajor, KernelMode mode = KernelMode::Fast) const {
+    evaluate(parameters.data(), parameters.size(), output, layout, mode);
+  }
+
+private:
+  template <KernelMode mode>
+  void evaluateTiles(const CosmologicalParameters* parameters, std::size_t count, const DistanceMatrixOutput& output,
+                     MatrixLayout layout) const {
+    const std::size_t z_count = m_order.size();
+    const auto        index   = [&](std::size_t cosmology, std::size_t sorted_z) {
+      return layout == MatrixLayout::RowMajor ? cosmology * z_count + m_order[sorted_z]
+                                              : m_order[sorted_z] * count + cosmology;
+    };
+
+    std::vector<Constants> constants(m_cosmology_tile);
+    std::vector<double>    integral(m_cosmology_tile);
+    for (std::size_t c0 = 0; c0 < count; c0 += m_cosmology_tile) {
+      const std::size_t c1 = std::min(count, c0 + m_cosmology_tile);
+      for (std::size_t c = c0; c < c1; ++c) {
+        constants[c - c0] = Constants{parameters[c]};
+        integral[c - c0]  = 0.;
+      }
+
+      for (std::size_t j0 = 0; j0 < z_count;) {
+        // Extend the redshift tile while its nodes fit in the node tile, but by at least one redshift
+        const std::size_t first_node = j0 == 0 ? 0 : m_end[j0 - 1];
+        std::size_t       j1         = j0 + 1;
+        while (j1 < z_count && m_end[j1] - first_node <= m_node_tile) {
+          ++j1;
+        }
+
+        for (std::size_t c = c0; c < c1; ++c) {
+          const Constants& k   = constants[c - c0];
+          double           sum = integral[c - c0];
+          for (std::size_t j = j0; j < j1; ++j) {
+            double panel = 0.;
+            for (std::size_t n = j == 0 ? 0 : m_end[j - 1]; n < m_end[j]; ++n) {
+              panel += m_node_weight[n] /
+                       std::sqrt(multiplyAdd<mode>(k.omega_m, m_node_x3[n],
+                                                   multiplyAdd<mode>(k.omega_k, m_node_x2[n], k.omega_lambda)));
+            }
+            sum += panel;
+            const double comoving = k.hubble_distance * sum;
+            if (output.comoving != nullptr) {
+              output.comoving[index(c, j)] = comoving;
+            }
+            if (output.transverse != nullptr) {
+              output.transverse[index(c, j)] = k.template transverse<mode>(comoving);
+            }
+            if (output.hubble != nullptr) {
+              const double x             = m_x[j];
+              output.hubble[index(c, j)] =
+                  k.hubble_constant *
+                  std::sqrt(multiplyAdd<mode>(multiplyAdd<mode>(k.omega_m, x, k.omega_k) * x, x, k.omega_lambda));
+            }
+          }
+          integral[c - c0] = sum;
+        }
+        j0 = j1;
+      }
+    }
+  }
+
+  /// What the inner loops need from one cosmology
+  struct Constants {
+    Constants() = default;
+
+    explicit Constants(const CosmologicalParameters& parameters)
+      : omega_m{parameters.getOmegaM()}
+      , omega_k{parameters.getOmegaK()}
+      , omega_lambda{parameters.getOmegaLambda()}
+      , hubble_constant{parameters.getHubbleConstant()}
+      , hubble_distance{CosmologicalDistances::s_speed_of_light / hubble_constant} {}
+
+    /// D_M from the curvature series of CosmologicalDistances, truncated below an ULP as the panels are precise
+    template <KernelMode mode>
+    double transverse(double comoving) const {
+      const double ratio = comoving / hubble_distance;
+      return comoving * CosmologicalDistances::transverseRatio<mode>(omega_k * ratio * ratio,
+                                                                     std::numeric_limits<double>::epsilon());
+    }
+
+    double omega_m{0.}, omega_k{0.}, omega_lambda{0.}, hubble_constant{0.}, hubble_distance{0.};
+  };
+
+  std::vector<std::size_t> m_order;
+  /// For each sorted redshift, the end of its nodes in the node arrays
+  std::vector<std::size_t> m_end;
+  /// 1 + z of the sorted redshifts
+  std::vector<double> m_x;
+  /// Powers of 1 + z and Gauss-Legendre weights of the nodes, shared by all the cosmologies
+  std::vector<double> m_node_x2, m_node_x3, m_node_weight;
+  std::size_t         m_cosmology_tile;
+  std::size_t         m_node_tile;
+};
+
+}  // namespace PhysicsUtils
+}  // namespace Euclid
+#endif /* PHYSICSUTILS_PHYSICSUTILS_DISTANCEMATRIX_H_ */
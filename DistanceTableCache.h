@@ -0,0 +1,179 @@
+/*
+ * Copyright (C) 2012-2021 Euclid Science Ground Segment
+ *
+ * This library is free software; you can redistribute it and/or modify it under
+ * the terms of the GNU Lesser General Public License as published by the Free
+ * Software Foundation; either version 3.0 of the License, or (at your option)
+ * any later version.
+ *
+ * This library is distributed in the hope that it will be useful, but WITHOUT
+ * ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS
+ * FOR A PARTICULAR PURPOSE. See the GNU Lesser General Public License for more
+ * details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with this library; if not, write to the Free Software Foundation, Inc.,
+ * 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA
+ */
+
+#ifndef PHYSICSUTILS_PHYSICSUTILS_DISTANCETABLECACHE_H_
+#define PHYSICSUTILS_PHYSICSUTILS_DISTANCETABLECACHE_H_
+
+#include "ComovingDistanceTable.h"
+#include "CosmologicalDistances.h"
+#include "CosmologicalParameters.h"
+#include "Tracing.h"
+#include <cstddef>
+#include <list>
+#include <memory>
+#include <mutex>
+#include <unordered_map>
+#include <utility>
+#include <vector>
+
+namespace Euclid {
+namespace PhysicsUtils {
+
+/**
+ * @class DistanceTableCache
+ *
+ * @brief Per-cosmology cache of ComovingDistanceTable with byte accounting and a memory budget
+ *
+ * @details Every table owned by the cache is accounted with its ComovingDistanceTable::memoryUsage().
+ *   When inserting a table takes the total above the budget, the least recently used tables are
+ *   evicted until it fits again. The most recent table is always kept, even if it alone exceeds the
+ *   budget. A budget of 0 means unlimited.
+ *
+ *   Tables are handed out as shared pointers: an evicted table stays valid for the callers still
+ *   holding it, but it is no longer counted against the budget. All the methods are thread safe.
+ */
+class DistanceTableCache {
+public:
+  /// @throws std::invalid_argument if ComovingDistanceTable::checkGeometry() rejects z_max and table_size
+  explicit DistanceTableCache(std::size_t memory_budget = 0, double z_max = 10., std::size_t table_size = 4096)
+    : m_memory_budget{memory_budget}
+    , m_z_max{z_max}
+    , m_table_size{ComovingDistanceTable::checkGeometry(z_max, table_size)} {}
+
+  /// Return the table of the given cosmology, building it on a miss
+  std::shared_ptr<const ComovingDistanceTable> table(const CosmologicalParameters& parameters) {
+    {
+      PHYSICSUTILS_TRACE_SCOPE("DistanceTableCache lookup", "cache");
+      std::lock_guard<std::mutex> lock{m_mutex};
+      auto                        found = m_entries.find(parameters);
+      if (found != m_entries.end()) {
+        m_lru.splice(m_lru.begin(), m_lru, found->second);
+        ++m_hits;
+        return found->second->second;
+      }
+      ++m_misses;
+    }
+
+    // Build without holding the lock, a concurrent build of the same cosmology is simply dropped
+    auto built = std::make_shared<const ComovingDistanceTable>(m_distances, parameters, m_z_max, m_table_size);
+
+    std::lock_guard<std::mutex> lock{m_mutex};
+    auto                        found = m_entries.find(parameters);
+    if (found != m_entries.end()) {
+      m_lru.splice(m_lru.begin(), m_lru, found->second);
+      return found->second->second;
+    }
+    m_lru.emplace_front(parameters, built);
+    m_entries.emplace(parameters, m_lru.begin());
+    m_memory_usage += built->memoryUsage();
+    enforceBudget();
+    return built;
+  }
+
+  /// Bytes owned by the cache for all the cosmologies
+  std::size_t memoryUsage() const {
+    std::lock_guard<std::mutex> lock{m_mutex};
+    return m_memory_usage;
+  }
+
+  /// Bytes owned by the cache for one cosmology, 0 if it is not cached
+  std::size_t memoryUsage(const CosmologicalParameters& parameters) const {
+    std::lock_guard<std::mutex> lock{m_mutex};
+    auto                        found = m_entries.find(parameters);
+    return found != m_entries.end() ? found->second->second->memoryUsage() : 0;
+  }
+
+  /// Bytes owned per cached cosmology, most recently used first
+  std::vector<std::pair<CosmologicalParameters, std::size_t>> memoryReport() const {
+    std::lock_guard<std::mutex>                                 lock{m_mutex};
+    std::vector<std::pair<CosmologicalParameters, std::size_t>> report;
+    report.reserve(m_lru.size());
+    for (const auto& entry : m_lru) {
+      report.emplace_back(entry.first, entry.second->memoryUsage());
+    }
+    return report;
+  }
+
+  std::size_t getMemoryBudget() const {
+    std::lock_guard<std::mutex> lock{m_mutex};
+    return m_memory_budget;
+  }
+
+  /// Change the budget, evicting immediately if the cache no longer fits
+  void setMemoryBudget(std::size_t memory_budget) {
+    std::lock_guard<std::mutex> lock{m_mutex};
+    m_memory_budget = memory_budget;
+    enforceBudget();
+  }
+
+  std::size_t size() const {
+    std::lock_guard<std::mutex> lock{m_mutex};
+    return m_lru.size();
+  }
+
+  std::size_t hits() const {
+    std::lock_guard<std::mutex> lock{m_mutex};
+    return m_hits;
+  }
+
+  std::size_t misses() const {
+    std::lock_guard<std::mutex> lock{m_mutex};
+    return m_misses;
+  }
+
+  std::size_t evictions() const {
+    std::lock_guard<std::mutex> lock{m_mutex};
+    return m_evictions;
+  }
+
+  void clear() {
+    std::lock_guard<std::mutex> lock{m_mutex};
+    m_entries.clear();
+    m_lru.clear();
+    m_memory_usage = 0;
+  }
+
+private:
+  using Entry = std::pair<CosmologicalParameters, std::shared_ptr<const ComovingDistanceTable>>;
+
+  void enforceBudget() {
+    while (m_memory_budget != 0 && m_memory_usage > m_memory_budget && m_lru.size() > 1) {
+      const Entry& victim = m_lru.back();
+      m_memory_usage -= victim.second->memoryUsage();
+      m_entries.erase(victim.first);
+      m_lru.pop_back();
+      ++m_evictions;
+    }
+  }
+
+  CosmologicalDistances                                                 m_distances{};
+  mutable std::mutex                                                    m_mutex;
+  std::list<Entry>                                                      m_lru;
+  std::unordered_map<CosmologicalParameters, std::list<Entry>::iterator> m_entries;
+  std::size_t                                                           m_memory_budget;
+  std::size_t                                                           m_memory_usage{0};
+  double                                                                m_z_max;
+  std::size_t                                                           m_table_size;
+  std::size_t                                                           m_hits{0};
+  std::size_t                                                           m_misses{0};
+  std::size_t                                                           m_evictions{0};
+};
+
+}  // namespace PhysicsUtils
+}  // namespace Euclid
+#endif /* PHYSICSUTILS_PHYSICSUTILS_DISTANCETABLECACHE_H_ */
@@ -0,0 +1,265 @@
+/*
+ * Copyright (C) 2012-2021 Euclid Science Ground Segment
+ *
+ * This library is free software; you can redistribute it and/or modify it under
+ * the terms of the GNU Lesser General Public License as published by the Free
+ * Software Foundation; either version 3.0 of the License, or (at your option)
+ * any later version.
+ *
+ * This library is distributed in the hope that it will be useful, but WITHOUT
+ * ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS
+ * FOR A PARTICULAR PURPOSE. See the GNU Lesser General Public License for more
+ * details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with this library; if not, write to the Free Software Foundation, Inc.,
+ * 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA
+ */
+
+#ifndef PHYSICSUTILS_PHYSICSUTILS_EXECUTOR_H_
+#define PHYSICSUTILS_PHYSICSUTILS_EXECUTOR_H_
+
+#include <algorithm>
+#include <condition_variable>
+#include <cstddef>
+#include <deque>
+#include <exception>
+#include <functional>
+#include <mutex>
+#include <thread>
+#include <utility>
+#include <vector>
+
+namespace Euclid {
+namespace PhysicsUtils {
+
+/**
+ * @class Executor
+ *
+ * @brief Scheduler of the parallel loops of the library
+ *
+ * @details Every multi-threaded path (ParallelDistances, the ComovingKdTree build, the PairCounter
+ *   and FloatVerification sweeps) splits its work into concurrency() tasks or fewer and hands them
+ *   to bulk(), which returns once they have all run. A host application that already owns a
+ *   scheduler implements this interface, or wraps it with FunctionExecutor, so that the library
+ *   runs on its threads instead of starting its own.
+ *
+ *   The tasks of one bulk() call may run in any order and on any thread, the calling one
+ *   included; a task may itself call bulk() on the same executor.
+ */
+class Executor {
+public:
+  using Task = std::function<void(std::size_t)>;
+
+  virtual ~Executor() = default;
+
+  /// Number of tasks that can usefully run at the same time, the calling thread included
+  virtual std::size_t concurrency() const = 0;
+
+  /// Run task(0) to task(count - 1) and return when all are done, rethrowing the first exception
+  virtual void bulk(std::size_t count, const Task& task) = 0;
+};
+
+/**
+ * @class InlineExecutor
+ *
+ * @brief Runs every task on the calling thread, for hosts that parallelize at a coarser level
+ */
+class InlineExecutor : public Executor {
+public:
+  std::size_t concurrency() const override {
+    return 1;
+  }
+
+  void bulk(std::size_t count, const Task& task) override {
+    for (std::size_t i = 0; i < count; ++i) {
+      task(i);
+    }
+  }
+};
+
+/**
+ * @class FunctionExecutor
+ *
+ * @brief Adapter of a host scheduler given as a callable
+ *
+ * @details bulk(count, task) is forwarded to the callable, which must run every task before
+ *   returning. With TBB and OpenMP, for instance:
+ *
+ *       FunctionExecutor tbb_executor{tbb::this_task_arena::max_concurrency(),
+ *                                     [](std::size_t count, const Executor::Task& task) {
+ *                                       tbb::parallel_for(std::size_t{0}, count, task);
+ *                                     }};
+ *
+ *       FunctionExecutor omp_executor{omp_get_max_threads(),
+ *                                     [](std::size_t count, const Executor::Task& task) {
+ *                                       #pragma omp parallel for schedule(dynamic, 1)
+ *                                       for (std::size_t i = 0; i < count; ++i) task(i);
+ *                                     }};
+ */
+class FunctionExecutor : public Executor {
+public:
+  using Bulk = std::function<void(std::size_t, const Task&)>;
+
+  FunctionExecutor(std::size_t concurrency, Bulk bulk)
+    : m_concurrency{std::max<std::size_t>(concurrency, 1)}, m_bulk(std::move(bulk)) {}
+
+  std::size_t concurrency() const override {
+    return m_concurrency;
+  }
+
+  void bulk(std::size_t count, const Task& task) override {
+    m_bulk(count, task);
+  }
+
+private:
+  std::size_t m_concurrency;
+  Bulk        m_bulk;
+};
+
+/**
+ * @class ThreadPoolExecutor
+ *
+ * @brief Fixed pool of thread_count - 1 worker threads, the caller of bulk() being the last one
+ *
+ * @details The workers are started once and sleep between bulk() calls, instead of the threads
+ *   started and joined by each call before. The tasks are claimed one by one under the pool mutex:
+ *   the library submits at most a few tasks per thread, each a large chunk of work. A caller
+ *   waiting for its tasks runs its own unclaimed ones first, so nested bulk() calls from inside a
+ *   task make progress.
+ */
+class ThreadPoolExecutor : public Executor {
+public:
+  explicit ThreadPoolExecutor(std::size_t thread_count = std::thread::hardware_concurrency())
+    : m_concurrency{std::max<std::size_t>(thread_count, 1)} {
+    m_workers.reserve(m_concurrency - 1);
+    for (std::size_t i = 1; i < m_concurrency; ++i) {
+      m_workers.emplace_back(&ThreadPoolExecutor::work, this);
+    }
+  }
+
+  ThreadPoolExecutor(const ThreadPoolExecutor&)            = delete;
+  ThreadPoolExecutor& operator=(const ThreadPoolExecutor&) = delete;
+
+  ~ThreadPoolExecutor() override {
+    {
+      std::lock_guard<std::mutex> lock(m_mutex);
+      m_stop = true;
+    }
+    m_wake.notify_all();
+    for (auto& worker : m_workers) {
+      worker.join();
+    }
+  }
+
+  std::size_t concurrency() const override {
+    return m_concurrency;
+  }
+
+  void bulk(std::size_t count, const Task& task) override {
+    if (count == 0) {
+      return;
+    }
+    if (count == 1 || m_workers.empty()) {
+      for (std::size_t i = 0; i < count; ++i) {
+        task(i);
+      }
+      return;
+    }
+    Job                          job{&task, count};
+    std::unique_lock<std::mutex> lock(m_mutex);
+    m_jobs.push_back(&job);
+    m_wake.notify_all();
+    while (job.next < job.count) {
+      runOne(lock, job);
+    }
+    m_done.wait(lock, [&job] { return job.done == job.count; });
+    if (job.error) {
+      std::rethrow_exception(job.error);
+    }
+  }
+
+private:
+  struct Job {
+    const Task*        task;
+    std::size_t        count;
+    std::size_t        next{0};
+    std::size_t        done{0};
+    std::exception_ptr error{};
+  };
+
+  /// Claim and run the next task of job, the lock being held on entry and on return
+  void runOne(std::unique_lock<std::mutex>& lock, Job& job) {
+    const std::size_t index = job.next++;
+    if (job.next == job.count) {
+      m_jobs.erase(std::find(m_jobs.begin(), m_jobs.end(), &job));
+    }
+    lock.unlock();
+    std::exception_ptr error;
+    try {
+      (*job.task)(index);
+    } catch (...) {
+      error = std::current_exception();
+    }
+    lock.lock();
+    if (error && !job.error) {
+      job.error = error;
+    }
+    if (++job.done == job.count) {
+      m_done.notify_all();
+    }
+  }
+
+  void work() {
+    std::unique_lock<std::mutex> lock(m_mutex);
+    while (true) {
+      m_wake.wait(lock, [this] { return m_stop || !m_jobs.empty(); });
+      if (m_jobs.empty()) {
+        return;
+      }
+      runOne(lock, *m_jobs.front());
+    }
+  }
+
+  const std::size_t        m_concurrency;
+  std::mutex               m_mutex;
+  std::condition_variable  m_wake;
+  std::condition_variable  m_done;
+  std::deque<Job*>         m_jobs;
+  bool                     m_stop{false};
+  std::vector<std::thread> m_workers;
+};
+
+/**
+ * The executor used when none is given: a single ThreadPoolExecutor over the hardware threads,
+ * started on first use and shared by every object of the library.
+ */
+inline Executor& defaultExecutor() {
+  static ThreadPoolExecutor executor;
+  return executor;
+}
+
+/**
+ * Call function(begin, end) over [0, count) in at most concurrency() chunks, whose boundaries are
+ * multiples of alignment so that two tasks never write into the same cache line of an output. An
+ * alignment of 0 is taken as 1.
+ */
+template <typename Function>
+void parallelFor(Executor& executor, std::size_t count, std::size_t alignment, Function&& function) {
+  alignment               = std::max<std::size_t>(alignment, 1);
+  const std::size_t tasks = std::max<std::size_t>(executor.concurrency(), 1);
+  std::size_t       chunk = (count + tasks - 1) / tasks;
+  chunk                   = (chunk + alignment - 1) / alignment * alignment;
+  if (chunk >= count) {
+    function(std::size_t{0}, count);
+    return;
+  }
+  executor.bulk((count + chunk - 1) / chunk, [&](std::size_t task) {
+    const std::size_t begin = task * chunk;
+    function(begin, std::min(begin + chunk, count));
+  });
+}
+
+}  // namespace PhysicsUtils
+}  // namespace Euclid
+#endif /* PHYSICSUTILS_PHYSICSUTILS_EXECUTOR_H_ */
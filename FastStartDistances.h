@@ -0,0 +1,132 @@
+/*
+ * Copyright (C) 2012-2021 Euclid Science Ground Segment
+ *
+ * This library is free software; you can redistribute it and/or modify it under
+ * the terms of the GNU Lesser General Public License as published by the Free
+ * Software Foundation; either version 3.0 of the License, or (at your option)
+ * any later version.
+ *
+ * This library is distributed in the hope that it will be useful, but WITHOUT
+ * ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS
+ * FOR A PARTICULAR PURPOSE. See the GNU Lesser General Public License for more
+ * details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with this library; if not, write to the Free Software Foundation, Inc.,
+ * 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA
+ */
+
+#ifndef PHYSICSUTILS_PHYSICSUTILS_FASTSTARTDISTANCES_H_
+#define PHYSICSUTILS_PHYSICSUTILS_FASTSTARTDISTANCES_H_
+
+#include "ComovingDistanceTable.h"
+#include "CosmologicalDistances.h"
+#include "CosmologicalParameters.h"
+#include "Tracing.h"
+#include <atomic>
+#include <cstddef>
+#include <exception>
+#include <memory>
+#include <thread>
+
+namespace Euclid {
+namespace PhysicsUtils {
+
+/**
+ * @class FastStartDistances
+ *
+ * @brief Comoving distances available right after construction, refined in the background
+ *
+ * @details The constructor only builds a coarse table of coarse_size nodes, which answers the
+ *   first queries within the interpolation error of that grid. The precise table is built by a
+ *   background thread and takes over, atomically, as soon as it is complete. Short lived jobs
+ *   that only need a handful of approximate distances never wait for the precise table.
+ *
+ *   An exception thrown by the background build is kept and rethrown by every later lookup and
+ *   by waitUntilPrecise(), instead of terminating the process from the worker thread. Destroying
+ *   the object cancels a build still running, so that a short job does not exit at the pace of
+ *   the precise table.
+ */
+class FastStartDistances {
+public:
+  /// @throws std::invalid_argument if ComovingDistanceTable::checkGeometry() rejects one of the two tables
+  FastStartDistances(const CosmologicalParameters& parameters, double z_max = 10., std::size_t size = 4096,
+                     std::size_t coarse_size = 65, double relative_precision = 0.0000001)
+    : m_coarse{CosmologicalDistances{}, parameters, z_max, coarse_size, relative_precision} {
+    ComovingDistanceTable::checkGeometry(z_max, size);
+    m_warm_up = std::thread([this, parameters, z_max, size, relative_precision] {
+      PHYSICSUTILS_TRACE_SCOPE("FastStartDistances warm-up", "table");
+      try {
+        m_precise_storage =
+            ComovingDistanceTable::build(CosmologicalDistances{}, parameters, z_max, size, relative_precision, m_stop);
+        m_precise.store(m_precise_storage.get(), std::memory_order_release);
+      } catch (...) {
+        m_error = std::current_exception();
+        m_failed.store(true, std::memory_order_release);
+      }
+    });
+  }
+
+  FastStartDistances(const FastStartDistances&)            = delete;
+  FastStartDistances& operator=(const FastStartDistances&) = delete;
+
+  /// Cancel the background build, which stops within ComovingDistanceTable::s_build_block nodes
+  ~FastStartDistances() {
+    m_stop.store(true, std::memory_order_relaxed);
+    m_warm_up.join();
+  }
+
+  double comovingDistance(double z) const {
+    return currentTable()(z);
+  }
+
+  void comovingDistance(const double* z, std::size_t count, double* out, KernelMode mode = KernelMode::Fast) const {
+    currentTable()(z, count, out, mode);
+  }
+
+  /// True once the answers come from the precise table
+  bool isPrecise() const {
+    return m_precise.load(std::memory_order_acquire) != nullptr;
+  }
+
+  /**
+   * @brief Block until the precise table is in use
+   * @throws the exception of the background build if it failed
+   */
+  void waitUntilPrecise() const {
+    while (!isPrecise()) {
+      rethrowFailure();
+      std::this_thread::yield();
+    }
+  }
+
+private:
+  const ComovingDistanceTable& currentTable() const {
+    const ComovingDistanceTable* precise = m_precise.load(std::memory_order_acquire);
+    if (precise != nullptr) {
+      return *precise;
+    }
+    rethrowFailure();
+    return m_coarse;
+  }
+
+  void rethrowFailure() const {
+    if (m_failed.load(std::memory_order_acquire)) {
+      std::rethrow_exception(m_error);
+    }
+  }
+
+  ComovingDistanceTable                     m_coarse;
+  std::unique_ptr<ComovingDistanceTable>    m_precise_storage;
+  std::atomic<const ComovingDistanceTable*> m_precise{nullptr};
+  /// Set by the background thread before m_failed
+  std::exception_ptr                        m_error;
+  std::atomic<bool>                         m_failed{false};
+  /// Set by the destructor, so that it does not wait for the rest of the precise table
+  std::atomic<bool>                         m_stop{false};
+  std::thread                               m_warm_up;
+};
+
+}  // namespace PhysicsUtils
+}  // namespace Euclid
+#endif /* PHYSICSUTILS_PHYSICSUTILS_FASTSTARTDISTANCES_H_ */
@@ -0,0 +1,157 @@
+/*
+ * Copyright (C) 2012-2021 Euclid Science Ground Segment
+ *
+ * This library is free software; you can redistribute it and/or modify it under
+ * the terms of the GNU Lesser General Public License as published by the Free
+ * Software Foundation; either version 3.0 of the License, or (at your option)
+ * any later version.
+ *
+ * This library is distributed in the hope that it will be useful, but WITHOUT
+ * ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS
+ * FOR A PARTICULAR PURPOSE. See the GNU Lesser General Public License for more
+ * details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with this library; if not, write to the Free Software Foundation, Inc.,
+ * 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA
+ */
+
+#ifndef PHYSICSUTILS_PHYSICSUTILS_FIXEDCOSMOLOGYDISTANCES_H_
+#define PHYSICSUTILS_PHYSICSUTILS_FIXEDCOSMOLOGYDISTANCES_H_
+
+#include "CosmologicalDistances.h"
+#include "CosmologicalParameters.h"
+#include "KernelMode.h"
+#include "Quadrature.h"
+#include "Tracing.h"
+#include <cmath>
+#include <cstddef>
+#include <limits>
+
+namespace Euclid {
+namespace PhysicsUtils {
+
+/**
+ * The default parameters of CosmologicalParameters as a compile-time cosmology. Any struct with the
+ * three static constexpr members can be used in the same way.
+ */
+struct FiducialCosmology {
+  static constexpr double omega_m         = 0.3089;
+  static constexpr double omega_lambda    = 0.6911;
+  static constexpr double hubble_constant = 67.74;
+};
+
+enum class Curvature { Flat, Open, Closed };
+
+/**
+ * @class FixedCosmologyDistances
+ *
+ * @brief The distances of CosmologicalDistances for a cosmology known at compile time
+ *
+ * @details Cosmology is a struct with static constexpr omega_m, omega_lambda and hubble_constant,
+ *   which works in C++17 where floating point template parameters do not. Omega_k, the curvature
+ *   class and the Hubble distance are then constant expressions: the integrand
+ *   coefficients are immediates, so the tight loops have no loads of the parameters, and a flat
+ *   cosmology skips the curvature series of CosmologicalDistances::transverseRatio() by
+ *   if constexpr.
+ *
+ *   A curvature below s_flat_tolerance in absolute value, typically the rounding of
+ *   1 - Omega_m - Omega_Lambda for a flat model, is classified as flat. The integrals take the
+ *   KernelMode of CosmologicalDistances as a template argument.
+ */
+template <typename Cosmology = FiducialCosmology>
+class FixedCosmologyDistances {
+public:
+  static constexpr double s_flat_tolerance = 1e-12;
+
+  static constexpr double    s_omega_m         = Cosmology::omega_m;
+  static constexpr double    s_omega_lambda    = Cosmology::omega_lambda;
+  static constexpr double    s_omega_k         = 1.0 - s_omega_m - s_omega_lambda;
+  static constexpr double    s_hubble_constant = Cosmology::hubble_constant;
+  static constexpr double    s_hubble_distance = CosmologicalDistances::s_speed_of_light / s_hubble_constant;
+  static constexpr Curvature s_curvature       = s_omega_k > s_flat_tolerance    ? Curvature::Open
+                                                 : s_omega_k < -s_flat_tolerance ? Curvature::Closed
+                                                                                 : Curvature::Flat;
+
+  static_assert(s_hubble_constant > 0., "The Hubble constant must be positive");
+
+  /// The same cosmology as a runtime parameter set
+  static CosmologicalParameters getParameters() {
+    return CosmologicalParameters{s_omega_m, s_omega_lambda, s_hubble_constant};
+  }
+
+  /// E(z) = H(z) / H0
+  template <KernelMode mode = KernelMode::Fast>
+  static double hubbleParameter(double z) {
+    const double x = 1. + z;
+    return std::sqrt(multiplyAdd<mode>(multiplyAdd<mode>(s_omega_m, x, s_omega_k) * x, x, s_omega_lambda));
+  }
+
+  template <KernelMode mode = KernelMode::Fast, typename Criterion = QuadratureConvergence<>>
+  static double comovingDistance(double z, const Criterion& converged = Criterion{}) {
+    const auto integrand = [](double x) {
+      return 1. / hubbleParameter<mode>(x);
+    };
+    return s_hubble_distance * rombergIntegral<mode>(integrand, 0., z, converged).value;
+  }
+
+  template <KernelMode mode = KernelMode::Fast, typename Criterion = QuadratureConvergence<>>
+  static double transverseComovingDistance(double z, const Criterion& converged = Criterion{}) {
+    return transverse<mode>(comovingDistance<mode>(z, converged));
+  }
+
+  template <KernelMode mode = KernelMode::Fast, typename Criterion = QuadratureConvergence<>>
+  static double luminosityDistance(double z, const Criterion& converged = Criterion{}) {
+    return (1. + z) * transverseComovingDistance<mode>(z, converged);
+  }
+
+  /// D_M from D_C with the curvature series of CosmologicalDistances, skipped at compile time when flat
+  template <KernelMode mode = KernelMode::Fast>
+  static double transverse(double comoving) {
+    if constexpr (s_curvature == Curvature::Flat) {
+      return comoving;
+    } else {
+      const double ratio = comoving / s_hubble_distance;
+      return comoving * CosmologicalDistances::transverseRatio<mode>(s_omega_k * ratio * ratio,
+                                                                     std::numeric_limits<double>::epsilon());
+    }
+  }
+
+  /**
+   * @name Batch API
+   *
+   * As the batch API of CosmologicalDistances, out may alias z.
+   * @{
+   */
+  template <KernelMode mode = KernelMode::Fast, typename Criterion = QuadratureConvergence<>>
+  static void comovingDistance(const double* z, std::size_t count, double* out,
+                               const Criterion& converged = Criterion{}) {
+    PHYSICSUTILS_TRACE_SCOPE("FixedCosmologyDistances comovingDistance batch", "quadrature");
+    for (std::size_t i = 0; i < count; ++i) {
+      out[i] = comovingDistance<mode>(z[i], converged);
+    }
+  }
+
+  template <KernelMode mode = KernelMode::Fast, typename Criterion = QuadratureConvergence<>>
+  static void transverseComovingDistance(const double* z, std::size_t count, double* out,
+                                         const Criterion& converged = Criterion{}) {
+    PHYSICSUTILS_TRACE_SCOPE("FixedCosmologyDistances transverseComovingDistance batch", "quadrature");
+    for (std::size_t i = 0; i < count; ++i) {
+      out[i] = transverseComovingDistance<mode>(z[i], converged);
+    }
+  }
+
+  template <KernelMode mode = KernelMode::Fast, typename Criterion = QuadratureConvergence<>>
+  static void luminosityDistance(const double* z, std::size_t count, double* out,
+                                 const Criterion& converged = Criterion{}) {
+    PHYSICSUTILS_TRACE_SCOPE("FixedCosmologyDistances luminosityDistance batch", "quadrature");
+    for (std::size_t i = 0; i < count; ++i) {
+      out[i] = luminosityDistance<mode>(z[i], converged);
+    }
+  }
+  /** @} */
+};
+
+}  // namespace PhysicsUtils
+}  // namespace Euclid
+#endif /* PHYSICSUTILS_PHYSICSUTILS_FIXEDCOSMOLOGYDISTANCES_H_ */
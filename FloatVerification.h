@@ -0,0 +1,188 @@
+/*
+ * Copyright (C) 2012-2021 Euclid Science Ground Segment
+ *
+ * This library is free software; you can redistribute it and/or modify it under
+ * the terms of the GNU Lesser General Public License as published by the Free
+ * Software Foundation; either version 3.0 of the License, or (at your option)
+ * any later version.
+ *
+ * This library is distributed in the hope that it will be useful, but WITHOUT
+ * ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS
+ * FOR A PARTICULAR PURPOSE. See the GNU Lesser General Public License for more
+ * details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with this library; if not, write to the Free Software Foundation, Inc.,
+ * 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA
+ */
+
+#ifndef PHYSICSUTILS_PHYSICSUTILS_FLOATVERIFICATION_H_
+#define PHYSICSUTILS_PHYSICSUTILS_FLOATVERIFICATION_H_
+
+#include "Executor.h"
+#include "Real.h"
+#include <algorithm>
+#include <atomic>
+#include <cmath>
+#include <cstdint>
+#include <cstring>
+#include <limits>
+#include <memory>
+#include <vector>
+
+namespace Euclid {
+namespace PhysicsUtils {
+
+/// Outcome of an exhaustive comparison of a float kernel with its double reference
+struct UlpReport {
+  /// Number of inputs checked, all the floats of the range but the NaNs
+  std::uint64_t count{0};
+  /// Largest error, in ULPs of the float closest to the reference
+  double max_ulps{0.};
+  /// Input and values where max_ulps was reached
+  float  worst_input{0.f};
+  float  worst_result{0.f};
+  double worst_reference{0.};
+  /// Inputs for which the result and the reference disagree on being finite
+  std::uint64_t non_finite_mismatches{0};
+  float         first_non_finite_mismatch{0.f};
+
+  void merge(const UlpReport& other) {
+    count += other.count;
+    if (other.max_ulps > max_ulps) {
+      max_ulps        = other.max_ulps;
+      worst_input     = other.worst_input;
+      worst_result    = other.worst_result;
+      worst_reference = other.worst_reference;
+    }
+    if (non_finite_mismatches == 0) {
+      first_non_finite_mismatch = other.first_non_finite_mismatch;
+    }
+    non_finite_mismatches += other.non_finite_mismatches;
+  }
+};
+
+/**
+ * @class FloatVerification
+ *
+ * @brief Exhaustive check of a single precision kernel over every float of a range
+ *
+ * @details The floats are enumerated through their biased representation of
+ *   Elements::FloatingPoint, in which consecutive integers are consecutive floats, so that a
+ *   range [lower, upper] is a plain integer range and the whole 2^32 domain can be split evenly
+ *   between threads. NaN inputs are skipped.
+ *
+ *   For each input x the error is |kernel(x) - reference(x)| divided by the spacing of the floats
+ *   around the reference, so that a correctly rounded kernel stays within 0.5 ULP.
+ */
+class FloatVerification {
+public:
+  using Bits = Elements::FloatingPoint<float>::Bits;
+
+  /// The executor must outlive this object
+  explicit FloatVerification(Executor& executor = defaultExecutor()) : m_executor{&executor} {}
+
+  explicit FloatVerification(std::size_t thread_count)
+    : m_pool{std::make_shared<ThreadPoolExecutor>(thread_count)}, m_executor{m_pool.get()} {}
+
+  template <typename Kernel, typename Reference>
+  UlpReport run(Kernel kernel, Reference reference, float lower = -std::numeric_limits<float>::infinity(),
+                float upper = std::numeric_limits<float>::infinity()) const {
+    const std::uint64_t first = toBiased(lower);
+    const std::uint64_t last  = toBiased(upper);
+    if (first > last) {
+      return UlpReport{};
+    }
+    constexpr std::uint64_t    chunk = 1 << 16;
+    std::atomic<std::uint64_t> next{first};
+    const std::size_t          tasks = m_executor->concurrency();
+    std::vector<UlpReport>     reports(tasks);
+    m_executor->bulk(tasks, [&](std::size_t task) {
+      UlpReport& report = reports[task];
+      for (std::uint64_t begin = next.fetch_add(chunk); begin <= last; begin = next.fetch_add(chunk)) {
+        const std::uint64_t end = std::min(last, begin + chunk - 1);
+        for (std::uint64_t biased = begin; biased <= end; ++biased) {
+          check(fromBiased(biased), kernel, reference, report);
+        }
+      }
+    });
+    UlpReport total;
+    for (const auto& report : reports) {
+      total.merge(report);
+    }
+    return total;
+  }
+
+  /// Spacing of the floats at the magnitude of value, the denormal spacing near 0
+  static double ulp(double value) {
+    const float magnitude = static_cast<float>(std::abs(value));
+    if (!(magnitude < std::numeric_limits<float>::max())) {
+      return std::ldexp(1., std::numeric_limits<float>::max_exponent - std::numeric_limits<float>::digits);
+    }
+    const float next = std::nextafter(magnitude, std::numeric_limits<float>::infinity());
+    return static_cast<double>(next) - static_cast<double>(magnitude);
+  }
+
+private:
+  static std::uint64_t toBiased(float value) {
+    Bits bits;
+    std::memcpy(&bits, &value, sizeof(bits));
+    return Elements::FloatingPoint<float>::signAndMagnitudeToBiased(bits);
+  }
+
+  static float fromBiased(std::uint64_t biased) {
+    const Bits sign  = Elements::FloatingPoint<float>::s_sign_bitmask;
+    const Bits value = static_cast<Bits>(biased);
+    const Bits bits  = (value & sign) ? (value & ~sign) : static_cast<Bits>(~value + 1);
+    float      result;
+    std::memcpy(&result, &bits, sizeof(result));
+    return result;
+  }
+
+  static bool isNan(float value) {
+    Bits bits;
+    std::memcpy(&bits, &value, sizeof(bits));
+    return (bits & Elements::FloatingPoint<float>::s_exponent_bitmask) ==
+               Elements::FloatingPoint<float>::s_exponent_bitmask &&
+           (bits & Elements::FloatingPoint<float>::s_fraction_bitmask) != 0;
+  }
+
+  template <typename Kernel, typename Reference>
+  static void check(float x, Kernel& kernel, Reference& reference, UlpReport& report) {
+    if (isNan(x)) {
+      return;
+    }
+    ++report.count;
+    const float  result   = kernel(x);
+    const double expected = reference(static_cast<double>(x));
+    // The reference may legitimately overflow the float range: compare with its float rounding
+    const bool result_finite   = std::isfinite(result);
+    const bool expected_finite = std::isfinite(static_cast<float>(expected));
+    if (result_finite != expected_finite || (!result_finite && result != static_cast<float>(expected))) {
+      if (std::isnan(result) && std::isnan(expected)) {
+        return;
+      }
+      if (report.non_finite_mismatches++ == 0) {
+        report.first_non_finite_mismatch = x;
+      }
+      return;
+    }
+    if (!result_finite) {
+      return;
+    }
+    const double error = std::abs(static_cast<double>(result) - expected) / ulp(expected);
+    if (error > report.max_ulps) {
+      report.max_ulps        = error;
+      report.worst_input     = x;
+      report.worst_result    = result;
+      report.worst_reference = expected;
+    }
+  }
+
+  std::shared_ptr<ThreadPoolExecutor> m_pool;
+  Executor*                           m_executor;
+};
+
+}  // namespace PhysicsUtils
+}  // namespace Euclid
+#endif /* PHYSICSUTILS_PHYSICSUTILS_FLOATVERIFICATION_H_ */
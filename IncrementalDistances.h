@@ -0,0 +1,258 @@
+/*
+ * Copyright (C) 2012-2021 Euclid Science Ground Segment
+ *
+ * This library is free software; you can redistribute it and/or modify it under
+ * the terms of the GNU Lesser General Public License as published by the Free
+ * Software Foundation; either version 3.0 of the License, or (at your option)
+ * any later version.
+ *
+ * This library is distributed in the hope that it will be useful, but WITHOUT
+ * ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS
+ * FOR A PARTICULAR PURPOSE. See the GNU Lesser General Public License for more
+ * details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with this library; if not, write to the Free Software Foundation, Inc.,
+ * 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA
+ */
+
+#ifndef PHYSICSUTILS_PHYSICSUTILS_INCREMENTALDISTANCES_H_
+#define PHYSICSUTILS_PHYSICSUTILS_INCREMENTALDISTANCES_H_
+
+#include "ArrowWriter.h"
+#include "CosmologicalParameters.h"
+#include "Tracing.h"
+#include <cstddef>
+#include <cstdint>
+#include <filesystem>
+#include <fstream>
+#include <functional>
+#include <stdexcept>
+#include <string>
+#include <utility>
+
+namespace Euclid {
+namespace PhysicsUtils {
+
+/// State of an append-only catalog after a run, persisted between runs
+struct Watermark {
+  /// Number of catalog rows whose distances are in the output
+  std::uint64_t rows{0};
+  /// IncrementalDistances::checksum of the redshifts of these rows
+  std::uint64_t checksum{0};
+  /// std::hash of the cosmological parameters of the distances
+  std::uint64_t cosmology{0};
+  /// Size of the output file, end-of-stream marker included when sealed
+  std::uint64_t output_bytes{0};
+  /// False while a run appends to the output: output_bytes is then the end of the rows above, without the marker
+  bool sealed{true};
+};
+
+/// Outcome of IncrementalDistances::update
+struct IncrementalReport {
+  std::size_t previous_rows{0};
+  std::size_t computed_rows{0};
+  /// The output was written from the first row: first run, or the watermark did not match
+  bool from_scratch{false};
+};
+
+/**
+ * @class IncrementalDistances
+ *
+ * @brief Distances of an append-only catalog, computed only for the rows appended since the
+ *   previous run
+ *
+ * @details The output is an Arrow stream with the columns of writeArrowDistances. After each run
+ *   a Watermark is written next to it: the number of rows done, a checksum of their redshifts,
+ *   the hash of the cosmology and the size of the output. The next update() with the grown
+ *   redshift column cuts the end-of-stream marker of the output and appends record batches for
+ *   the new rows only.
+ *
+ *   The output is rewritten from the first row when the watermark is missing or does not match:
+ *   another cosmology, fewer rows than before, a redshift of the previous rows changed, or an
+ *   output that is not the one the watermark describes. With verify_prefix the checksum of the
+ *   previous rows is recomputed, a pass over the column far cheaper than the distances; without
+ *   it the stored checksum is trusted and only extended.
+ *
+ *   The watermark is always replaced atomically. Before the end-of-stream marker is cut, it is
+ *   replaced by an unsealed one whose output_bytes is the end of the previous rows, and the sealed
+ *   watermark of the new rows is only written once the output has been flushed. The watermark is
+ *   removed before the output is rewritten from the first row. A run interrupted at any point is
+ *   then resumed by the next one from the rows of the last completed run: the output is cut back
+ *   to the end of these rows, dropping whatever the interrupted run appended.
+ */
+class IncrementalDistances {
+public:
+  static constexpr std::uint64_t s_checksum_seed = Detail::hash_seed;
+
+  IncrementalDistances(std::string output_path, std::string watermark_path, const CosmologicalParameters& parameters,
+                       bool verify_prefix = true, std::size_t batch_rows = 1 << 16)
+    : m_output_path(std::move(output_path))
+    , m_watermark_path(std::move(watermark_path))
+    , m_parameters(parameters)
+    , m_verify_prefix{verify_prefix}
+    , m_batch_rows{batch_rows > 0 ? batch_rows : 1} {}
+
+  /**
+   * @brief Bring the output up to date with the count redshifts of the catalog
+   * @throws std::runtime_error if the output or the watermark cannot be written
+   */
+  IncrementalReport update(const double* z, std::size_t count) const {
+    PHYSICSUTILS_TRACE_SCOPE("IncrementalDistances update", "io");
+    const std::uint64_t cosmology = std::hash<CosmologicalParameters>{}(m_parameters);
+    Watermark           previous;
+    bool                resume = loadWatermark(m_watermark_path, previous) && previous.cosmology == cosmology;
+    resume = resume && previous.rows <= count && describesOutput(previous);
+    if (resume && m_verify_prefix) {
+      resume = checksum(z, previous.rows) == previous.checksum;
+    }
+
+    IncrementalReport report;
+    std::ofstream     out;
+    std::uint64_t     data_bytes = 0;
+    if (resume) {
+      data_bytes = previous.sealed ? previous.output_bytes - ArrowWriter::s_end_of_stream_size : previous.output_bytes;
+      if (previous.sealed) {
+        Watermark unsealed    = previous;
+        unsealed.output_bytes = data_bytes;
+        unsealed.sealed       = false;
+        saveWatermark(m_watermark_path, unsealed);
+      }
+      // Cut the end-of-stream marker, and whatever an interrupted run wrote after it
+      std::filesystem::resize_file(m_output_path, data_bytes);
+      out.open(m_output_path, std::ios::binary | std::ios::app);
+      report.previous_rows = previous.rows;
+    } else {
+      std::filesystem::remove(m_watermark_path);
+      out.open(m_output_path, std::ios::binary | std::ios::trunc);
+      previous            = Watermark{0, s_checksum_seed, cosmology, 0};
+      report.from_scratch = true;
+    }
+    if (!out) {
+      throw std::runtime_error("IncrementalDistances: cannot open " + m_output_path);
+    }
+
+    const std::size_t first = report.previous_rows;
+    report.computed_rows    = count - first;
+    {
+      ArrowWriter writer{out, arrowDistanceColumns(),
+                         resume ? ArrowWriter::Format::Batches : ArrowWriter::Format::Stream,
+                         static_cast<std::int64_t>(data_bytes)};
+      appendArrowDistances(writer, z + first, report.computed_rows, m_parameters, m_batch_rows);
+      writer.close();
+    }
+    out.close();
+    if (!out) {
+      throw std::runtime_error("IncrementalDistances: failed to write " + m_output_path);
+    }
+
+    const Watermark next{count, checksum(z + first, report.computed_rows, previous.checksum), cosmology,
+                         std::filesystem::file_size(m_output_path)};
+    saveWatermark(m_watermark_path, next);
+    return report;
+  }
+
+  /**
+   * Checksum of count redshifts, checksum(a + b) being checksum(b, checksum(a)) for appended rows.
+   * The same mixing as std::hash<CosmologicalParameters>, on the exact bit patterns.
+   */
+  static std::uint64_t checksum(const double* z, std::size_t count, std::uint64_t seed = s_checksum_seed) {
+    std::uint64_t hash = seed;
+    for (std::size_t i = 0; i < count; ++i) {
+      hash = Detail::mixHash(hash, z[i]);
+    }
+    return hash;
+  }
+
+  /**
+   * @brief Read a watermark written by saveWatermark
+   * @return false if there is no file at path or it is not a well-formed watermark, e.g. one cut
+   *   short by a full disk, so that update() rewrites the output from the first row
+   */
+  static bool loadWatermark(const std::string& path, Watermark& watermark) {
+    std::ifstream in(path);
+    if (!in) {
+      return false;
+    }
+    std::string magic, rows, checksum, cosmology, output_bytes, sealed = "sealed";
+    int         version = 0, sealed_flag = 1;
+    in >> magic >> version >> rows >> watermark.rows >> checksum >> std::hex >> watermark.checksum >> cosmology >>
+        watermark.cosmology >> output_bytes >> std::dec >> watermark.output_bytes;
+    // Version 1 had no sealed line, its watermarks were all written after the output
+    if (version >= 2) {
+      in >> sealed >> sealed_flag;
+    }
+    if (!in || magic != s_magic || version < 1 || version > s_version || rows != "rows" || checksum != "checksum" ||
+        cosmology != "cosmology" || output_bytes != "output_bytes" || sealed != "sealed" ||
+        (sealed_flag != 0 && sealed_flag != 1)) {
+      watermark = Watermark{};
+      return false;
+    }
+    watermark.sealed = sealed_flag == 1;
+    return true;
+  }
+
+  /// Write a watermark to a temporary file renamed over path, so that path is always complete
+  static void saveWatermark(const std::string& path, const Watermark& watermark) {
+    const std::string temporary = path + ".tmp";
+    {
+      std::ofstream out(temporary, std::ios::trunc);
+      out << s_magic << ' ' << s_version << '\n'
+          << "rows " << watermark.rows << '\n'
+          << "checksum " << std::hex << watermark.checksum << '\n'
+          << "cosmology " << watermark.cosmology << '\n'
+          << "output_bytes " << std::dec << watermark.output_bytes << '\n'
+          << "sealed " << (watermark.sealed ? 1 : 0) << '\n';
+      out.close();
+      if (!out) {
+        throw std::runtime_error("IncrementalDistances: failed to write " + temporary);
+      }
+    }
+    std::filesystem::rename(temporary, path);
+  }
+
+  const std::string& getOutputPath() const {
+    return m_output_path;
+  }
+
+  const std::string& getWatermarkPath() const {
+    return m_watermark_path;
+  }
+
+private:
+  static constexpr const char* s_magic   = "physicsutils-watermark";
+  static constexpr int         s_version = 2;
+
+  /**
+   * Whether the output has at least output_bytes bytes and, for a sealed watermark, the last of
+   * them are an end-of-stream marker
+   */
+  bool describesOutput(const Watermark& watermark) const {
+    std::error_code     error;
+    const std::uint64_t size = std::filesystem::file_size(m_output_path, error);
+    if (error || size < watermark.output_bytes) {
+      return false;
+    }
+    if (!watermark.sealed) {
+      return watermark.output_bytes > 0;
+    }
+    if (watermark.output_bytes < ArrowWriter::s_end_of_stream_size) {
+      return false;
+    }
+    std::ifstream in(m_output_path, std::ios::binary);
+    in.seekg(static_cast<std::streamoff>(watermark.output_bytes - ArrowWriter::s_end_of_stream_size));
+    std::uint32_t marker[2] = {0, 1};
+    in.read(reinterpret_cast<char*>(marker), sizeof(marker));
+    return in && marker[0] == 0xFFFFFFFF && marker[1] == 0;
+  }
+
+  std::string            m_output_path;
+  std::string            m_watermark_path;
+  CosmologicalParameters m_parameters;
+  bool                   m_verify_prefix;
+  std::size_t            m_batch_rows;
+};
+
+}  // namespace PhysicsUtils
+}  // namespace Euclid
+#endif /* PHYSICSUTILS_PHYSICSUTILS_INCREMENTALDISTANCES_H_ */
@@ -0,0 +1,162 @@
+/*
+ * Copyright (C) 2012-2021 Euclid Science Ground Segment
+ *
+ * This library is free software; you can redistribute it and/or modify it under
+ * the terms of the GNU Lesser General Public License as published by the Free
+ * Software Foundation; either version 3.0 of the License, or (at your option)
+ * any later version.
+ *
+ * This library is distributed in the hope that it will be useful, but WITHOUT
+ * ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS
+ * FOR A PARTICULAR PURPOSE. See the GNU Lesser General Public License for more
+ * details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with this library; if not, write to the Free Software Foundation, Inc.,
+ * 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA
+ */
+
+#ifndef PHYSICSUTILS_PHYSICSUTILS_INTERVAL_H_
+#define PHYSICSUTILS_PHYSICSUTILS_INTERVAL_H_
+
+#include <algorithm>
+#include <cmath>
+#include <limits>
+
+namespace Euclid {
+namespace PhysicsUtils {
+
+/**
+ * @class Interval
+ *
+ * @brief Closed interval of reals with outward rounded arithmetic
+ *
+ * @details Every operation is computed in the default round-to-nearest mode and its bounds are
+ *   then moved at least one ULP outwards. The basic operations and sqrt are correctly rounded by
+ *   IEEE 754, so the result is a rigorous enclosure without changing the rounding mode of the FPU,
+ *   which would be both slow and ignored by the optimizer without -frounding-math. Functions of
+ *   libm that are not correctly rounded are widened by s_libm_ulps instead.
+ */
+class Interval {
+public:
+  /// Documented maximum error of the glibc sinh and sin is below this many ULPs
+  static constexpr int s_libm_ulps = 4;
+
+  constexpr Interval(double value = 0.) : m_lower{value}, m_upper{value} {}  // NOLINT implicit on purpose
+
+  constexpr Interval(double lower, double upper) : m_lower{lower}, m_upper{upper} {}
+
+  constexpr double lower() const {
+    return m_lower;
+  }
+
+  constexpr double upper() const {
+    return m_upper;
+  }
+
+  double midpoint() const {
+    return 0.5 * m_lower + 0.5 * m_upper;
+  }
+
+  double width() const {
+    return roundUp(m_upper - m_lower);
+  }
+
+  bool contains(double value) const {
+    return m_lower <= value && value <= m_upper;
+  }
+
+  /**
+   * Move value down by at least ulps ULPs. Adding a relative step and the smallest subnormal is much
+   * cheaper than the out-of-line std::nextafter, and moves by at most one extra ULP.
+   */
+  static double roundDown(double value, int ulps = 1) {
+    if (!std::isfinite(value)) {
+      return value;
+    }
+    return value - (std::abs(value) * (ulps * std::numeric_limits<double>::epsilon()) +
+                    std::numeric_limits<double>::denorm_min());
+  }
+
+  static double roundUp(double value, int ulps = 1) {
+    if (!std::isfinite(value)) {
+      return value;
+    }
+    return value + (std::abs(value) * (ulps * std::numeric_limits<double>::epsilon()) +
+                    std::numeric_limits<double>::denorm_min());
+  }
+
+  friend Interval operator+(const Interval& left, const Interval& right) {
+    return {roundDown(left.m_lower + right.m_lower), roundUp(left.m_upper + right.m_upper)};
+  }
+
+  friend Interval operator-(const Interval& left, const Interval& right) {
+    return {roundDown(left.m_lower - right.m_upper), roundUp(left.m_upper - right.m_lower)};
+  }
+
+  friend Interval operator-(const Interval& value) {
+    return {-value.m_upper, -value.m_lower};
+  }
+
+  friend Interval operator*(const Interval& left, const Interval& right) {
+    const double products[] = {left.m_lower * right.m_lower, left.m_lower * right.m_upper,
+                               left.m_upper * right.m_lower, left.m_upper * right.m_upper};
+    return {roundDown(*std::min_element(products, products + 4)), roundUp(*std::max_element(products, products + 4))};
+  }
+
+  /// Division, the whole real line if the divisor contains 0
+  friend Interval operator/(const Interval& left, const Interval& right) {
+    if (right.contains(0.)) {
+      return {-std::numeric_limits<double>::infinity(), std::numeric_limits<double>::infinity()};
+    }
+    const double quotients[] = {left.m_lower / right.m_lower, left.m_lower / right.m_upper,
+                                left.m_upper / right.m_lower, left.m_upper / right.m_upper};
+    return {roundDown(*std::min_element(quotients, quotients + 4)),
+            roundUp(*std::max_element(quotients, quotients + 4))};
+  }
+
+  Interval& operator+=(const Interval& other) {
+    return *this = *this + other;
+  }
+
+  /// Square root of the non-negative part, NaN bounds if the interval is entirely negative
+  friend Interval sqrt(const Interval& value) {
+    return {std::max(0., roundDown(std::sqrt(std::max(0., value.m_lower)))), roundUp(std::sqrt(value.m_upper))};
+  }
+
+  friend Interval square(const Interval& value) {
+    const double lower = std::abs(value.m_lower), upper = std::abs(value.m_upper);
+    const double low   = value.contains(0.) ? 0. : roundDown(std::min(lower, upper) * std::min(lower, upper));
+    return {low, roundUp(std::max(lower, upper) * std::max(lower, upper))};
+  }
+
+  /// sinh is increasing
+  friend Interval sinh(const Interval& value) {
+    return {roundDown(std::sinh(value.m_lower), s_libm_ulps), roundUp(std::sinh(value.m_upper), s_libm_ulps)};
+  }
+
+  /// sin over a non-negative interval, as needed for the angular distances of closed universes
+  friend Interval sin(const Interval& value) {
+    const double half_pi = 1.5707963267948966;  // rounded down
+    const double pi      = 3.1415926535897931;  // rounded down
+    if (value.m_lower < 0. || value.m_upper >= pi) {
+      return {-1., 1.};
+    }
+    const double lower = std::sin(value.m_lower), upper = std::sin(value.m_upper);
+    if (value.m_upper <= half_pi) {
+      return {roundDown(lower, s_libm_ulps), roundUp(upper, s_libm_ulps)};
+    }
+    if (value.m_lower > half_pi * (1. + 1e-15)) {
+      return {roundDown(upper, s_libm_ulps), roundUp(lower, s_libm_ulps)};
+    }
+    return {roundDown(std::min(lower, upper), s_libm_ulps), 1.};
+  }
+
+private:
+  double m_lower;
+  double m_upper;
+};
+
+}  // namespace PhysicsUtils
+}  // namespace Euclid
+#endif /* PHYSICSUTILS_PHYSICSUTILS_INTERVAL_H_ */
@@ -0,0 +1,75 @@
+/*
+ * Copyright (C) 2012-2021 Euclid Science Ground Segment
+ *
+ * This library is free software; you can redistribute it and/or modify it under
+ * the terms of the GNU Lesser General Public License as published by the Free
+ * Software Foundation; either version 3.0 of the License, or (at your option)
+ * any later version.
+ *
+ * This library is distributed in the hope that it will be useful, but WITHOUT
+ * ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS
+ * FOR A PARTICULAR PURPOSE. See the GNU Lesser General Public License for more
+ * details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with this library; if not, write to the Free Software Foundation, Inc.,
+ * 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA
+ */
+
+#ifndef PHYSICSUTILS_PHYSICSUTILS_KERNELMODE_H_
+#define PHYSICSUTILS_PHYSICSUTILS_KERNELMODE_H_
+
+#include <cmath>
+
+namespace Euclid {
+namespace PhysicsUtils {
+
+/**
+ * @brief Floating point contract of the batch kernels
+ *
+ * @details In the Fast mode the compiler is free to contract multiplications and additions into
+ *   FMA instructions, which it does differently for the scalar, AVX2 and AVX-512 code paths, so
+ *   that results can differ in the last bits between machines.
+ *
+ *   In the Reproducible mode every multiply-add of a kernel goes through multiplyAdd(), an explicit
+ *   std::fma in a fixed order, and every other operation is a single IEEE 754 operation that no
+ *   -ffp-contract setting can fuse. An FMA is correctly rounded by definition, so the results are
+ *   bitwise identical whatever the ISA. The mode covers every kernel that takes it: the Romberg
+ *   engine, E(z) and the curvature series of CosmologicalDistances and FixedCosmologyDistances,
+ *   the DistanceMatrix panels and the ComovingDistanceTable lookups.
+ *
+ *   When the target has FMA units (hasHardwareFma(), e.g. -mfma or -march=x86-64-v3) std::fma is
+ *   a single instruction and the Reproducible kernels still vectorize. Otherwise, as on the
+ *   baseline x86-64 target, std::fma falls back to the correctly rounded software routine of libm:
+ *   the results are the same bits, but each multiply-add becomes a scalar function call and the
+ *   Reproducible mode is several times slower than the Fast one.
+ */
+enum class KernelMode { Fast, Reproducible };
+
+/// Whether std::fma is a hardware instruction on this target rather than the libm fallback
+constexpr bool hasHardwareFma() {
+#ifdef FP_FAST_FMA
+  return true;
+#else
+  return false;
+#endif
+}
+
+/// a b + c under the given contract, rounded once in the Reproducible mode
+template <KernelMode mode>
+inline double multiplyAdd(double a, double b, double c) {
+  if (mode == KernelMode::Reproducible) {
+    return std::fma(a, b, c);
+  }
+  return a * b + c;
+}
+
+/// Linear interpolation a + t (b - a) under the given contract
+template <KernelMode mode>
+inline double lerp(double a, double b, double t) {
+  return multiplyAdd<mode>(t, b - a, a);
+}
+
+}  // namespace PhysicsUtils
+}  // namespace Euclid
+#endif /* PHYSICSUTILS_PHYSICSUTILS_KERNELMODE_H_ */
@@ -0,0 +1,383 @@
+/*
+ * Copyright (C) 2012-2021 Euclid Science Ground Segment
+ *
+ * This library is free software; you can redistribute it and/or modify it under
+ * the terms of the GNU Lesser General Public License as published by the Free
+ * Software Foundation; either version 3.0 of the License, or (at your option)
+ * any later version.
+ *
+ * This library is distributed in the hope that it will be useful, but WITHOUT
+ * ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS
+ * FOR A PARTICULAR PURPOSE. See the GNU Lesser General Public License for more
+ * details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with this library; if not, write to the Free Software Foundation, Inc.,
+ * 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA
+ */
+
+#ifndef PHYSICSUTILS_PHYSICSUTILS_PAIRCOUNTER_H_
+#define PHYSICSUTILS_PHYSICSUTILS_PAIRCOUNTER_H_
+
+#include "ComovingPositions.h"
+#include "Executor.h"
+#include "Tracing.h"
+#include <algorithm>
+#include <atomic>
+#include <cmath>
+#include <cstddef>
+#include <cstdint>
+#include <limits>
+#include <memory>
+#include <stdexcept>
+#include <vector>
+
+namespace Euclid {
+namespace PhysicsUtils {
+
+/**
+ * @class SeparationBinning
+ *
+ * @brief Bins of the redshift-space separation s, for xi(s)
+ */
+class SeparationBinning {
+public:
+  /// edges are the increasing bounds of the bins in Mpc, one more than the number of bins
+  explicit SeparationBinning(const std::vector<double>& edges) : m_squared_edges(edges.size()) {
+    if (edges.size() < 2 || !std::is_sorted(edges.begin(), edges.end()) || edges.front() < 0.) {
+      throw std::invalid_argument("SeparationBinning: the edges must be at least two non-negative sorted values");
+    }
+    for (std::size_t i = 0; i < edges.size(); ++i) {
+      m_squared_edges[i] = edges[i] * edges[i];
+    }
+  }
+
+  std::size_t size() const {
+    return m_squared_edges.size() - 1;
+  }
+
+  double maxSeparation() const {
+    return std::sqrt(m_squared_edges.back());
+  }
+
+  /// Bin of a pair, size() if it is outside the edges
+  std::size_t bin(const Position&, const Position&, double d2) const {
+    if (d2 < m_squared_edges.front() || d2 >= m_squared_edges.back()) {
+      return size();
+    }
+    // Branch-free count of the edges below d2, which vectorizes for the usual few tens of edges
+    std::size_t below = 0;
+    for (double edge : m_squared_edges) {
+      below += d2 >= edge;
+    }
+    return below - 1;
+  }
+
+private:
+  std::vector<double> m_squared_edges;
+};
+
+/**
+ * @class ProjectedBinning
+ *
+ * @brief Bins of the separations perpendicular and parallel to the line of sight, for xi(r_p, pi)
+ *
+ * @details The line of sight of a pair is the direction of the midpoint of its two positions. The
+ *   bins are numbered r_p major, the bin (i, j) being i * piBins() + j.
+ */
+class ProjectedBinning {
+public:
+  ProjectedBinning(const std::vector<double>& rp_edges, double pi_max, std::size_t pi_bins)
+    : m_rp(rp_edges), m_pi_max{pi_max}, m_pi_bins{pi_bins}, m_pi_scale{static_cast<double>(pi_bins) / pi_max} {
+    if (!(pi_max > 0.) || pi_bins == 0) {
+      throw std::invalid_argument("ProjectedBinning: pi_max and pi_bins must be positive");
+    }
+  }
+
+  std::size_t size() const {
+    return m_rp.size() * m_pi_bins;
+  }
+
+  std::size_t piBins() const {
+    return m_pi_bins;
+  }
+
+  double maxSeparation() const {
+    return std::sqrt(m_rp.maxSeparation() * m_rp.maxSeparation() + m_pi_max * m_pi_max);
+  }
+
+  std::size_t bin(const Position& a, const Position& b, double d2) const {
+    const Position middle   = {a[0] + b[0], a[1] + b[1], a[2] + b[2]};
+    const double   norm2    = middle[0] * middle[0] + middle[1] * middle[1] + middle[2] * middle[2];
+    const double   parallel = (a[0] - b[0]) * middle[0] + (a[1] - b[1]) * middle[1] + (a[2] - b[2]) * middle[2];
+    const double   pi2      = norm2 > 0. ? parallel * parallel / norm2 : 0.;
+    const double   pi       = std::sqrt(pi2);
+    if (pi >= m_pi_max) {
+      return size();
+    }
+    const std::size_t rp_bin = m_rp.bin(a, b, std::max(0., d2 - pi2));
+    if (rp_bin == m_rp.size()) {
+      return size();
+    }
+    return rp_bin * m_pi_bins + std::min(m_pi_bins - 1, static_cast<std::size_t>(pi * m_pi_scale));
+  }
+
+private:
+  SeparationBinning m_rp;
+  double            m_pi_max;
+  std::size_t       m_pi_bins;
+  double            m_pi_scale;
+};
+
+/// Weighted pair counts per bin, with the weighted number of pairs used to normalize them
+struct PairCounts {
+  std::vector<double> counts;
+  double              total{0.};
+
+  double normalized(std::size_t bin) const {
+    return total > 0. ? counts[bin] / total : 0.;
+  }
+};
+
+/**
+ * @class PairCounter
+ *
+ * @brief Weighted pair counting of comoving positions in separation bins
+ *
+ * @details The positions are hashed into a grid of cubic cells no smaller than the largest
+ *   separation, and sorted by cell into coordinate arrays, so that only the 27 neighbouring cells
+ *   of a cell need to be visited. The squared distances of a position to all the positions of a
+ *   neighbouring cell are computed by a loop with no branch, which vectorizes, before the pairs
+ *   in range are binned.
+ *
+ *   The cells are claimed by the tasks of the executor through an atomic counter, each task
+ *   filling its own histogram, and the histograms are summed at the end. An auto count visits each unordered pair
+ *   once, through the 13 neighbours that come after a cell.
+ */
+template <typename Binning>
+class PairCounter {
+public:
+  /// The executor must outlive this object
+  explicit PairCounter(Binning binning, Executor& executor = defaultExecutor())
+    : m_binning(std::move(binning)), m_executor{&executor} {}
+
+  PairCounter(Binning binning, std::size_t thread_count)
+    : m_binning(std::move(binning))
+    , m_pool{std::make_shared<ThreadPoolExecutor>(thread_count)}
+    , m_executor{m_pool.get()} {}
+
+  const Binning& getBinning() const {
+    return m_binning;
+  }
+
+  /// DD or RR, weights may be null for unit weights
+  PairCounts countAuto(const Position* positions, const double* weights, std::size_t count) const {
+    PHYSICSUTILS_TRACE_SCOPE("PairCounter auto", "spatial");
+    const Geometry geometry = makeGeometry(positions, count, positions, 0);
+    const Grid     grid     = makeGrid(geometry, positions, weights, count);
+    PairCounts     result   = run(geometry, grid, grid, true);
+    double         sum = 0., sum2 = 0.;
+    for (std::size_t i = 0; i < count; ++i) {
+      const double w = weights != nullptr ? weights[i] : 1.;
+      sum += w;
+      sum2 += w * w;
+    }
+    result.total = 0.5 * (sum * sum - sum2);
+    return result;
+  }
+
+  /// DR, weights may be null for unit weights
+  PairCounts countCross(const Position* first, const double* first_weights, std::size_t first_count,
+                        const Position* second, const double* second_weights, std::size_t second_count) const {
+    PHYSICSUTILS_TRACE_SCOPE("PairCounter cross", "spatial");
+    const Geometry geometry = makeGeometry(first, first_count, second, second_count);
+    const Grid     a        = makeGrid(geometry, first, first_weights, first_count);
+    const Grid     b        = makeGrid(geometry, second, second_weights, second_count);
+    PairCounts     result   = run(geometry, a, b, false);
+    result.total            = a.weight_sum * b.weight_sum;
+    return result;
+  }
+
+  /// Landy-Szalay estimator (DD - 2 DR + RR) / RR from normalized counts
+  static std::vector<double> landySzalay(const PairCounts& dd, const PairCounts& dr, const PairCounts& rr) {
+    std::vector<double> xi(dd.counts.size(), 0.);
+    for (std::size_t bin = 0; bin < xi.size(); ++bin) {
+      const double random = rr.normalized(bin);
+      if (random > 0.) {
+        xi[bin] = (dd.normalized(bin) - 2. * dr.normalized(bin) + random) / random;
+      }
+    }
+    return xi;
+  }
+
+private:
+  /// Bounds and cell counts shared by the grids of a cross count
+  struct Geometry {
+    Position    origin{};
+    double      inverse_cell{1.};
+    std::size_t cells[3]{1, 1, 1};
+
+    std::size_t cellCount() const {
+      return cells[0] * cells[1] * cells[2];
+    }
+
+    std::size_t axisCell(double value, std::size_t axis) const {
+      const double cell = std::floor((value - origin[axis]) * inverse_cell);
+      return std::min(cells[axis] - 1, static_cast<std::size_t>(std::max(0., cell)));
+    }
+  };
+
+  /// Coordinates and weights sorted by cell, the cell c spanning [start[c], start[c + 1])
+  struct Grid {
+    std::vector<double>      x, y, z, w;
+    std::vector<std::size_t> start;
+    double                   weight_sum{0.};
+  };
+
+  Geometry makeGeometry(const Position* first, std::size_t first_count, const Position* second,
+                        std::size_t second_count) const {
+    Position lower, upper;
+    lower.fill(std::numeric_limits<double>::infinity());
+    upper.fill(-std::numeric_limits<double>::infinity());
+    for (const auto& set : {std::make_pair(first, first_count), std::make_pair(second, second_count)}) {
+      for (std::size_t i = 0; i < set.second; ++i) {
+        for (std::size_t axis = 0; axis < 3; ++axis) {
+          lower[axis] = std::min(lower[axis], set.first[i][axis]);
+          upper[axis] = std::max(upper[axis], set.first[i][axis]);
+        }
+      }
+    }
+    Geometry geometry;
+    if (first_count + second_count == 0) {
+      return geometry;
+    }
+    // Cells of at least the largest separation, and no more cells than 2^24 for sparse catalogs
+    double cell = m_binning.maxSeparation();
+    for (std::size_t axis = 0; axis < 3; ++axis) {
+      cell = std::max(cell, (upper[axis] - lower[axis]) / 256.);
+    }
+    geometry.origin       = lower;
+    geometry.inverse_cell = cell > 0. ? 1. / cell : 1.;
+    for (std::size_t axis = 0; axis < 3; ++axis) {
+      geometry.cells[axis] = static_cast<std::size_t>((upper[axis] - lower[axis]) * geometry.inverse_cell) + 1;
+      geometry.cells[axis] = std::min<std::size_t>(geometry.cells[axis], 256);
+    }
+    return geometry;
+  }
+
+  static Grid makeGrid(const Geometry& geometry, const Position* positions, const double* weights,
+                       std::size_t count) {
+    Grid                     grid;
+    std::vector<std::size_t> cell_of(count);
+    grid.start.assign(geometry.cellCount() + 1, 0);
+    for (std::size_t i = 0; i < count; ++i) {
+      const Position& p = positions[i];
+      cell_of[i]        = (geometry.axisCell(p[2], 2) * geometry.cells[1] + geometry.axisCell(p[1], 1)) *
+                       geometry.cells[0] +
+                   geometry.axisCell(p[0], 0);
+      ++grid.start[cell_of[i] + 1];
+    }
+    for (std::size_t c = 0; c < geometry.cellCount(); ++c) {
+      grid.start[c + 1] += grid.start[c];
+    }
+    grid.x.resize(count);
+    grid.y.resize(count);
+    grid.z.resize(count);
+    grid.w.resize(count);
+    std::vector<std::size_t> fill(grid.start.begin(), grid.start.end() - 1);
+    for (std::size_t i = 0; i < count; ++i) {
+      const std::size_t slot = fill[cell_of[i]]++;
+      grid.x[slot]           = positions[i][0];
+      grid.y[slot]           = positions[i][1];
+      grid.z[slot]           = positions[i][2];
+      grid.w[slot]           = weights != nullptr ? weights[i] : 1.;
+      grid.weight_sum += grid.w[slot];
+    }
+    return grid;
+  }
+
+  PairCounts run(const Geometry& geometry, const Grid& a, const Grid& b, bool same) const {
+    const std::size_t                cell_count = geometry.cellCount();
+    const std::size_t                bins       = m_binning.size();
+    std::atomic<std::size_t>         next{0};
+    const std::size_t                tasks      = m_executor->concurrency();
+    std::vector<std::vector<double>> histograms(tasks, std::vector<double>(bins + 1, 0.));
+
+    m_executor->bulk(tasks, [&](std::size_t task) {
+      std::vector<double>& histogram = histograms[task];
+      std::vector<double>  d2;
+      constexpr std::size_t chunk = 16;
+      for (std::size_t first = next.fetch_add(chunk); first < cell_count; first = next.fetch_add(chunk)) {
+        for (std::size_t cell = first; cell < std::min(cell_count, first + chunk); ++cell) {
+          countCell(geometry, a, b, same, cell, histogram, d2);
+        }
+      }
+    });
+
+    PairCounts result;
+    result.counts.assign(bins, 0.);
+    for (const auto& histogram : histograms) {
+      for (std::size_t bin = 0; bin < bins; ++bin) {
+        result.counts[bin] += histogram[bin];
+      }
+    }
+    return result;
+  }
+
+  void countCell(const Geometry& geometry, const Grid& a, const Grid& b, bool same, std::size_t cell,
+                 std::vector<double>& histogram, std::vector<double>& d2) const {
+    const std::size_t cx = cell % geometry.cells[0];
+    const std::size_t cy = cell / geometry.cells[0] % geometry.cells[1];
+    const std::size_t cz = cell / geometry.cells[0] / geometry.cells[1];
+    const double      max2 = m_binning.maxSeparation() * m_binning.maxSeparation();
+
+    for (int dz = -1; dz <= 1; ++dz) {
+      for (int dy = -1; dy <= 1; ++dy) {
+        for (int dx = -1; dx <= 1; ++dx) {
+          const std::ptrdiff_t nx = static_cast<std::ptrdiff_t>(cx) + dx;
+          const std::ptrdiff_t ny = static_cast<std::ptrdiff_t>(cy) + dy;
+          const std::ptrdiff_t nz = static_cast<std::ptrdiff_t>(cz) + dz;
+          if (nx < 0 || ny < 0 || nz < 0 || nx >= static_cast<std::ptrdiff_t>(geometry.cells[0]) ||
+              ny >= static_cast<std::ptrdiff_t>(geometry.cells[1]) ||
+              nz >= static_cast<std::ptrdiff_t>(geometry.cells[2])) {
+            continue;
+          }
+          const std::size_t other =
+              (static_cast<std::size_t>(nz) * geometry.cells[1] + static_cast<std::size_t>(ny)) * geometry.cells[0] +
+              static_cast<std::size_t>(nx);
+          if (same && other < cell) {
+            continue;
+          }
+          const std::size_t other_begin = b.start[other], other_end = b.start[other + 1];
+          d2.resize(other_end - other_begin);
+          for (std::size_t i = a.start[cell]; i < a.start[cell + 1]; ++i) {
+            const std::size_t begin = same && other == cell ? i + 1 : other_begin;
+            const double      xi = a.x[i], yi = a.y[i], zi = a.z[i];
+            const double*     x  = b.x.data();
+            const double*     y  = b.y.data();
+            const double*     z  = b.z.data();
+            double*           d  = d2.data();
+            for (std::size_t j = begin; j < other_end; ++j) {
+              const double ddx   = x[j] - xi, ddy = y[j] - yi, ddz = z[j] - zi;
+              d[j - other_begin] = ddx * ddx + ddy * ddy + ddz * ddz;
+            }
+            const Position pi = {xi, yi, zi};
+            for (std::size_t j = begin; j < other_end; ++j) {
+              if (d[j - other_begin] < max2) {
+                histogram[m_binning.bin(pi, Position{x[j], y[j], z[j]}, d[j - other_begin])] += a.w[i] * b.w[j];
+              }
+            }
+          }
+        }
+      }
+    }
+  }
+
+  Binning                             m_binning;
+  std::shared_ptr<ThreadPoolExecutor> m_pool;
+  Executor*                           m_executor;
+};
+
+}  // namespace PhysicsUtils
+}  // namespace Euclid
+#endif /* PHYSICSUTILS_PHYSICSUTILS_PAIRCOUNTER_H_ */
@@ -0,0 +1,187 @@
+/*
+ * Copyright (C) 2012-2021 Euclid Science Ground Segment
+ *
+ * This library is free software; you can redistribute it and/or modify it under
+ * the terms of the GNU Lesser General Public License as published by the Free
+ * Software Foundation; either version 3.0 of the License, or (at your option)
+ * any later version.
+ *
+ * This library is distributed in the hope that it will be useful, but WITHOUT
+ * ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS
+ * FOR A PARTICULAR PURPOSE. See the GNU Lesser General Public License for more
+ * details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with this library; if not, write to the Free Software Foundation, Inc.,
+ * 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA
+ */
+
+#ifndef PHYSICSUTILS_PHYSICSUTILS_PARALLELDISTANCES_H_
+#define PHYSICSUTILS_PHYSICSUTILS_PARALLELDISTANCES_H_
+
+#include "CosmologicalDistances.h"
+#include "CosmologicalParameters.h"
+#include "DistanceAggregation.h"
+#include "Executor.h"
+#include "KernelMode.h"
+#include <algorithm>
+#include <cstddef>
+#include <memory>
+#include <utility>
+#include <vector>
+
+namespace Euclid {
+namespace PhysicsUtils {
+
+/**
+ * @class ParallelDistances
+ *
+ * @brief Multi-threaded front-end of the CosmologicalDistances batch API
+ *
+ * @details The input is split into one contiguous chunk per thread of the executor. The chunk
+ *   boundaries are multiples of s_chunk_alignment elements, so that two threads never write into
+ *   the same cache line of the output. The executor is the host's when one is given, the shared
+ *   defaultExecutor() otherwise; a thread count gives the object a pool of its own.
+ *
+ *   aggregate() reduces the distances instead of writing them: each task evaluates blocks of
+ *   s_aggregation_block distances into a buffer that stays in L1 and feeds them to its own copy of
+ *   the accumulator, and the copies are merged in task order at the end.
+ */
+class ParallelDistances {
+public:
+  static constexpr std::size_t s_chunk_alignment   = 64 / sizeof(double);
+  static constexpr std::size_t s_aggregation_block = 1024;
+
+  /// The executor must outlive this object
+  explicit ParallelDistances(Executor& executor = defaultExecutor()) : m_executor{&executor} {}
+
+  explicit ParallelDistances(std::size_t thread_count)
+    : m_pool{std::make_shared<ThreadPoolExecutor>(thread_count)}, m_executor{m_pool.get()} {}
+
+  std::size_t getThreadCount() const {
+    return m_executor->concurrency();
+  }
+
+  Executor& getExecutor() const {
+    return *m_executor;
+  }
+
+  void comovingDistance(const double* z, std::size_t count, double* out, const CosmologicalParameters& parameters,
+                        double relative_precision = 0.0000001) const {
+    parallelFor(count, [&](std::size_t begin, std::size_t end) {
+      m_distances.comovingDistance(z + begin, end - begin, out + begin, parameters, relative_precision);
+    });
+  }
+
+  void transverseComovingDistance(const double* z, std::size_t count, double* out,
+                                  const CosmologicalParameters& parameters,
+                                  double relative_precision = 0.0000001) const {
+    parallelFor(count, [&](std::size_t begin, std::size_t end) {
+      m_distances.transverseComovingDistance(z + begin, end - begin, out + begin, parameters, relative_precision);
+    });
+  }
+
+  void luminosityDistance(const double* z, std::size_t count, double* out, const CosmologicalParameters& parameters,
+                          double relative_precision = 0.0000001) const {
+    parallelFor(count, [&](std::size_t begin, std::size_t end) {
+      m_distances.luminosityDistance(z + begin, end - begin, out + begin, parameters, relative_precision);
+    });
+  }
+
+  /// The batch API with redshift derivatives and errors, see CosmologicalDistances
+  void comovingDistance(const double* z, std::size_t count, double* out, const CosmologicalParameters& parameters,
+                        const DistanceErrors& errors, double relative_precision = 0.0000001,
+                        KernelMode mode = KernelMode::Fast) const {
+    parallelFor(count, [&](std::size_t begin, std::size_t end) {
+      m_distances.comovingDistance(z + begin, end - begin, out + begin, parameters, errors.offset(begin),
+                                   relative_precision, mode);
+    });
+  }
+
+  void transverseComovingDistance(const double* z, std::size_t count, double* out,
+                                  const CosmologicalParameters& parameters, const DistanceErrors& errors,
+                                  double relative_precision = 0.0000001, KernelMode mode = KernelMode::Fast) const {
+    parallelFor(count, [&](std::size_t begin, std::size_t end) {
+      m_distances.transverseComovingDistance(z + begin, end - begin, out + begin, parameters, errors.offset(begin),
+                                             relative_precision, mode);
+    });
+  }
+
+  void luminosityDistance(const double* z, std::size_t count, double* out, const CosmologicalParameters& parameters,
+                          const DistanceErrors& errors, double relative_precision = 0.0000001,
+                          KernelMode mode = KernelMode::Fast) const {
+    parallelFor(count, [&](std::size_t begin, std::size_t end) {
+      m_distances.luminosityDistance(z + begin, end - begin, out + begin, parameters, errors.offset(begin),
+                                     relative_precision, mode);
+    });
+  }
+
+  /**
+   * @brief Reduce the distances of the count redshifts with no per-object output
+   * @details accumulator is copied for each task, its add(distance, weight) called for every
+   *   object and merge(other) to combine the copies, as DistanceHistogram, DistanceMoments and
+   *   DistanceSummary do. weights may be null for unit weights. The result depends on the
+   *   concurrency of the executor only, not on the scheduling of the tasks.
+   */
+  template <typename Accumulator>
+  Accumulator aggregate(DistanceKind kind, const double* z, const double* weights, std::size_t count,
+                        const CosmologicalParameters& parameters, const Accumulator& accumulator) const {
+    const std::size_t blocks = (count + s_aggregation_block - 1) / s_aggregation_block;
+    const std::size_t tasks  = std::max<std::size_t>(std::min(m_executor->concurrency(), blocks), 1);
+    std::vector<Accumulator> partials(tasks, accumulator);
+    m_executor->bulk(tasks, [&](std::size_t task) {
+      // Accumulate into a local copy, so that the tasks do not share the cache lines of partials
+      Accumulator       local    = accumulator;
+      const std::size_t end      = std::min(count, blocks * (task + 1) / tasks * s_aggregation_block);
+      double            distance[s_aggregation_block];
+      for (std::size_t begin = blocks * task / tasks * s_aggregation_block; begin < end;
+           begin += s_aggregation_block) {
+        const std::size_t rows = std::min(s_aggregation_block, end - begin);
+        evaluate(kind, z + begin, rows, distance, parameters);
+        if (weights != nullptr) {
+          for (std::size_t i = 0; i < rows; ++i) {
+            local.add(distance[i], weights[begin + i]);
+          }
+        } else {
+          for (std::size_t i = 0; i < rows; ++i) {
+            local.add(distance[i]);
+          }
+        }
+      }
+      partials[task] = std::move(local);
+    });
+    for (std::size_t task = 1; task < tasks; ++task) {
+      partials[0].merge(partials[task]);
+    }
+    return std::move(partials[0]);
+  }
+
+private:
+  void evaluate(DistanceKind kind, const double* z, std::size_t count, double* out,
+                const CosmologicalParameters& parameters) const {
+    switch (kind) {
+    case DistanceKind::Comoving:
+      m_distances.comovingDistance(z, count, out, parameters);
+      break;
+    case DistanceKind::Transverse:
+      m_distances.transverseComovingDistance(z, count, out, parameters);
+      break;
+    case DistanceKind::Luminosity:
+      m_distances.luminosityDistance(z, count, out, parameters);
+      break;
+    }
+  }
+
+  template <typename Function>
+  void parallelFor(std::size_t count, Function&& function) const {
+    PhysicsUtils::parallelFor(*m_executor, count, s_chunk_alignment, std::forward<Function>(function));
+  }
+
+  CosmologicalDistances               m_distances{};
+  std::shared_ptr<ThreadPoolExecutor> m_pool;
+  Executor*                           m_executor;
+};
+
+}  // namespace PhysicsUtils
+}  // namespace Euclid
+#endif /* PHYSICSUTILS_PHYSICSUTILS_PARALLELDISTANCES_H_ */
@@ -0,0 +1,153 @@
+/*
+ * Copyright (C) 2012-2021 Euclid Science Ground Segment
+ *
+ * This library is free software; you can redistribute it and/or modify it under
+ * the terms of the GNU Lesser General Public License as published by the Free
+ * Software Foundation; either version 3.0 of the License, or (at your option)
+ * any later version.
+ *
+ * This library is distributed in the hope that it will be useful, but WITHOUT
+ * ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS
+ * FOR A PARTICULAR PURPOSE. See the GNU Lesser General Public License for more
+ * details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with this library; if not, write to the Free Software Foundation, Inc.,
+ * 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA
+ */
+
+#ifndef PHYSICSUTILS_PHYSICSUTILS_QUADRATURE_H_
+#define PHYSICSUTILS_PHYSICSUTILS_QUADRATURE_H_
+
+#include "KernelMode.h"
+#include "Real.h"
+#include <array>
+#include <cmath>
+#include <cstddef>
+
+namespace Euclid {
+namespace PhysicsUtils {
+
+/**
+ * @class RelativeConvergence
+ *
+ * @brief Stop when two successive estimates differ by less than relative_precision
+ */
+class RelativeConvergence {
+public:
+  explicit RelativeConvergence(double relative_precision = 0.0000001) : m_relative_precision{relative_precision} {}
+
+  bool operator()(double previous, double current) const {
+    return std::abs(current - previous) <= m_relative_precision * std::abs(current);
+  }
+
+private:
+  double m_relative_precision;
+};
+
+/**
+ * @class UlpConvergence
+ *
+ * @brief Stop when two successive estimates are within max_ulps representable doubles
+ *
+ * @details Once the refinement only moves the estimate by a few ULPs, further work cannot
+ *   change the representable result any more. The default is the Elements tolerance used by
+ *   Elements::isEqual.
+ */
+template <std::size_t max_ulps = Elements::DBL_DEFAULT_MAX_ULPS>
+class UlpConvergence {
+public:
+  bool operator()(double previous, double current) const {
+    return Elements::isEqual<double, max_ulps>(previous, current);
+  }
+};
+
+/**
+ * @class QuadratureConvergence
+ *
+ * @brief The relative criterion, bounded by the ULP one
+ *
+ * @details Stops as soon as either criterion is met, so that a relative_precision set too tight
+ *   for double (e.g. 1e-18) no longer forces refinements that cannot change the result.
+ */
+template <std::size_t max_ulps = Elements::DBL_DEFAULT_MAX_ULPS>
+class QuadratureConvergence {
+public:
+  explicit QuadratureConvergence(double relative_precision = 0.0000001) : m_relative{relative_precision} {}
+
+  bool operator()(double previous, double current) const {
+    return m_relative(previous, current) || m_ulps(previous, current);
+  }
+
+private:
+  RelativeConvergence      m_relative;
+  UlpConvergence<max_ulps> m_ulps;
+};
+
+struct QuadratureResult {
+  double      value{0.};
+  /// Number of Romberg levels computed, each one doubling the number of panels
+  std::size_t levels{0};
+  std::size_t evaluations{0};
+  bool        converged{false};
+};
+
+/**
+ * @brief Romberg integration of function over [a, b]
+ * @details Level k is the trapezoid rule on 2^k panels, extrapolated k times. The iteration stops
+ *   when converged(previous diagonal, current diagonal) holds for two successive levels, or after
+ *   24 levels. A single agreement can be a coincidence of the early levels, e.g. the comoving
+ *   distance at z = 3.18 stopping at 16 panels 18 times further from the integral than asked.
+ *   The midpoints and the trapezoid updates are multiply-adds under mode, the Richardson steps
+ *   have none.
+ */
+template <KernelMode mode = KernelMode::Fast, typename Function, typename Criterion>
+QuadratureResult rombergIntegral(Function&& function, double a, double b, const Criterion& converged) {
+  constexpr std::size_t          max_levels = 24;
+  std::array<double, max_levels> previous{};
+  std::array<double, max_levels> current{};
+
+  QuadratureResult result;
+  const double     width = b - a;
+  previous[0]            = 0.5 * width * (function(a) + function(b));
+  result.evaluations     = 2;
+  result.levels          = 1;
+  result.value           = previous[0];
+  if (width == 0.) {
+    result.converged = true;
+    return result;
+  }
+
+  bool agreed = false;
+  for (std::size_t level = 1; level < max_levels; ++level) {
+    // Trapezoid refinement: add the midpoints of the 2^(level - 1) panels of the previous level
+    const std::size_t new_points = std::size_t{1} << (level - 1);
+    const double      step       = width / static_cast<double>(new_points);
+    double            sum        = 0.;
+    for (std::size_t i = 0; i < new_points; ++i) {
+      sum += function(multiplyAdd<mode>(static_cast<double>(i) + 0.5, step, a));
+    }
+    result.evaluations += new_points;
+    current[0] = 0.5 * multiplyAdd<mode>(step, sum, previous[0]);
+
+    double factor = 1.;
+    for (std::size_t k = 1; k <= level; ++k) {
+      factor *= 4.;
+      current[k] = current[k - 1] + (current[k - 1] - previous[k - 1]) / (factor - 1.);
+    }
+    result.levels = level + 1;
+    result.value  = current[level];
+    const bool agrees = converged(previous[level - 1], current[level]);
+    if (agrees && agreed) {
+      result.converged = true;
+      return result;
+    }
+    agreed = agrees;
+    previous.swap(current);
+  }
+  return result;
+}
+
+}  // namespace PhysicsUtils
+}  // namespace Euclid
+#endif /* PHYSICSUTILS_PHYSICSUTILS_QUADRATURE_H_ */
@@ -84,6 +84,8 @@ using std::numeric_limits;
 
 namespace Elements {
 
+/// Single precision float default maximum unit in the last place
+constexpr std::size_t FLT_DEFAULT_MAX_ULPS{4};
 /// Double precision float default maximum unit in the last place
 constexpr std::size_t DBL_DEFAULT_MAX_ULPS{10};
 
@@ -100,6 +102,14 @@ public:
   using UInt = void;
 };
 
+// The specialisation for size 4.
+template <>
+class ELEMENTS_API TypeWithSize<4> {
+public:
+  using Int  = int;           // NOLINT
+  using UInt = unsigned int;  // NOLINT
+};
+
 // The specialisation for size 8.
 template <>
 class ELEMENTS_API TypeWithSize<8> {
@@ -113,6 +123,11 @@ constexpr std::size_t defaultMaxUlps() {
   return DBL_DEFAULT_MAX_ULPS;
 }
 
+template <>
+constexpr std::size_t defaultMaxUlps<float>() {
+  return FLT_DEFAULT_MAX_ULPS;
+}
+
 template <>
 constexpr std::size_t defaultMaxUlps<double>() {
   return DBL_DEFAULT_MAX_ULPS;
@@ -0,0 +1,112 @@
+/*
+ * Copyright (C) 2012-2021 Euclid Science Ground Segment
+ *
+ * This library is free software; you can redistribute it and/or modify it under
+ * the terms of the GNU Lesser General Public License as published by the Free
+ * Software Foundation; either version 3.0 of the License, or (at your option)
+ * any later version.
+ *
+ * This library is distributed in the hope that it will be useful, but WITHOUT
+ * ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS
+ * FOR A PARTICULAR PURPOSE. See the GNU Lesser General Public License for more
+ * details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with this library; if not, write to the Free Software Foundation, Inc.,
+ * 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA
+ */
+
+#ifndef PHYSICSUTILS_PHYSICSUTILS_REDSHIFTFRAMECORRECTION_H_
+#define PHYSICSUTILS_PHYSICSUTILS_REDSHIFTFRAMECORRECTION_H_
+
+#include "CosmologicalDistances.h"
+#include "Tracing.h"
+#include <cmath>
+#include <cstddef>
+
+namespace Euclid {
+namespace PhysicsUtils {
+
+/// Motion of the Sun with respect to the CMB, Planck 2018 (l, b) = (264.021, 48.253) in J2000 equatorial
+struct CmbDipole {
+  /// Velocity in km/s
+  double velocity{369.82};
+  /// Direction in degrees
+  double right_ascension{167.942};
+  double declination{-6.944};
+};
+
+/**
+ * @class RedshiftFrameCorrection
+ *
+ * @brief Batch conversion of heliocentric redshifts into cosmological ones, in place
+ *
+ * @details The redshifts compose multiplicatively, (1 + z_obs) = (1 + z_cos) (1 + z_pec), with
+ *   the motion of the Sun towards the CMB dipole seen as 1 + z_sun = 1 - v cos(theta) / c for an
+ *   object at an angle theta from the apex, and the line of sight peculiar velocity of the object
+ *   as 1 + z_pec = 1 + v_pec / c. Both factors are folded into a single division per object.
+ *
+ *   The positions are the RA and Dec columns of the catalog, in degrees. cos(theta) is the dot
+ *   product of the unit vectors, computed from sines and cosines of the precomputed apex so that
+ *   the loop has no branch. The corrected column can be passed directly to the batch API of
+ *   CosmologicalDistances.
+ */
+class RedshiftFrameCorrection {
+public:
+  explicit RedshiftFrameCorrection(const CmbDipole& dipole = CmbDipole{})
+    : m_beta{dipole.velocity / CosmologicalDistances::s_speed_of_light}
+    , m_sin_declination{std::sin(dipole.declination * s_radians_per_degree)}
+    , m_cos_declination{std::cos(dipole.declination * s_radians_per_degree)}
+    , m_right_ascension{dipole.right_ascension * s_radians_per_degree} {}
+
+  /**
+   * @brief Replace the heliocentric redshifts z by CMB frame redshifts
+   * @details peculiar_velocity, the line of sight velocities in km/s, may be null to only remove
+   *   the dipole. Otherwise the result is the cosmological redshift.
+   */
+  void apply(double* z, const double* right_ascension, const double* declination, std::size_t count,
+             const double* peculiar_velocity = nullptr) const {
+    PHYSICSUTILS_TRACE_SCOPE("RedshiftFrameCorrection apply", "frames");
+    if (peculiar_velocity == nullptr) {
+      for (std::size_t i = 0; i < count; ++i) {
+        z[i] = (1. + z[i]) / solarFactor(right_ascension[i], declination[i]) - 1.;
+      }
+      return;
+    }
+    constexpr double inverse_c = 1. / CosmologicalDistances::s_speed_of_light;
+    for (std::size_t i = 0; i < count; ++i) {
+      const double factor = solarFactor(right_ascension[i], declination[i]) * (1. + peculiar_velocity[i] * inverse_c);
+      z[i]                = (1. + z[i]) / factor - 1.;
+    }
+  }
+
+  /// Remove the peculiar velocities (km/s) only, for redshifts already in the CMB frame
+  static void removePeculiarVelocity(double* z, const double* peculiar_velocity, std::size_t count) {
+    PHYSICSUTILS_TRACE_SCOPE("RedshiftFrameCorrection removePeculiarVelocity", "frames");
+    constexpr double inverse_c = 1. / CosmologicalDistances::s_speed_of_light;
+    for (std::size_t i = 0; i < count; ++i) {
+      z[i] = (1. + z[i]) / (1. + peculiar_velocity[i] * inverse_c) - 1.;
+    }
+  }
+
+  /// 1 + z_sun for an object at (right_ascension, declination) in degrees
+  double solarFactor(double right_ascension, double declination) const {
+    const double delta     = declination * s_radians_per_degree;
+    const double cos_theta = std::sin(delta) * m_sin_declination +
+                             std::cos(delta) * m_cos_declination *
+                                 std::cos(right_ascension * s_radians_per_degree - m_right_ascension);
+    return 1. - m_beta * cos_theta;
+  }
+
+private:
+  static constexpr double s_radians_per_degree = 0.017453292519943295;
+
+  double m_beta;
+  double m_sin_declination;
+  double m_cos_declination;
+  double m_right_ascension;
+};
+
+}  // namespace PhysicsUtils
+}  // namespace Euclid
+#endif /* PHYSICSUTILS_PHYSICSUTILS_REDSHIFTFRAMECORRECTION_H_ */
@@ -0,0 +1,210 @@
+/*
+ * Copyright (C) 2012-2021 Euclid Science Ground Segment
+ *
+ * This library is free software; you can redistribute it and/or modify it under
+ * the terms of the GNU Lesser General Public License as published by the Free
+ * Software Foundation; either version 3.0 of the License, or (at your option)
+ * any later version.
+ *
+ * This library is distributed in the hope that it will be useful, but WITHOUT
+ * ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS
+ * FOR A PARTICULAR PURPOSE. See the GNU Lesser General Public License for more
+ * details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with this library; if not, write to the Free Software Foundation, Inc.,
+ * 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA
+ */
+
+#ifndef PHYSICSUTILS_PHYSICSUTILS_SIGMAPOINTPROPAGATION_H_
+#define PHYSICSUTILS_PHYSICSUTILS_SIGMAPOINTPROPAGATION_H_
+
+#include "CosmologicalDistances.h"
+#include "CosmologicalParameters.h"
+#include "Tracing.h"
+#include <array>
+#include <cmath>
+#include <cstddef>
+#include <stdexcept>
+#include <vector>
+
+namespace Euclid {
+namespace PhysicsUtils {
+
+/**
+ * @class SigmaPointPropagation
+ *
+ * @brief Propagation of a covariance of the cosmological parameters into the distances
+ *
+ * @details The unscented transform evaluates the distances at 2n + 1 sigma points, the mean and
+ *   the mean moved by +/- sqrt(n + lambda) times the columns of the Cholesky factor of the
+ *   covariance, with lambda = alpha^2 (n + kappa) - n. The weighted mean and variance of these
+ *   evaluations match the true moments to second order in the parameters, which for the smooth
+ *   distances is what 10^4 Monte Carlo draws resolve, for 7 batch evaluations.
+ *
+ *   The parameters are (Omega_m, Omega_Lambda, H0) in that order, so n = 3. Omega_k follows from
+ *   the first two. The defaults alpha = 1, beta = 0, kappa = 0 put the points at +/- sqrt(3) sigma.
+ */
+class SigmaPointPropagation {
+public:
+  static constexpr std::size_t s_dimension   = 3;
+  static constexpr std::size_t s_point_count = 2 * s_dimension + 1;
+
+  /// Covariance of (Omega_m, Omega_Lambda, H0)
+  using Covariance = std::array<std::array<double, s_dimension>, s_dimension>;
+
+  explicit SigmaPointPropagation(double alpha = 1., double beta = 0., double kappa = 0.)
+    : m_lambda{alpha * alpha * (static_cast<double>(s_dimension) + kappa) - static_cast<double>(s_dimension)} {
+    const double scale = static_cast<double>(s_dimension) + m_lambda;
+    if (!(scale > 0.)) {
+      throw std::invalid_argument("SigmaPointPropagation: alpha^2 (n + kappa) must be positive");
+    }
+    m_mean_weights.fill(0.5 / scale);
+    m_variance_weights.fill(0.5 / scale);
+    m_mean_weights[0]     = m_lambda / scale;
+    m_variance_weights[0] = m_lambda / scale + 1. - alpha * alpha + beta;
+  }
+
+  /**
+   * @brief The sigma points, the mean first
+   * @throws std::invalid_argument if the covariance is not symmetric positive semi-definite
+   */
+  std::array<CosmologicalParameters, s_point_count> sigmaPoints(const CosmologicalParameters& mean,
+                                                                const Covariance&             covariance) const {
+    const Covariance                      factor = cholesky(covariance);
+    const double                          scale  = std::sqrt(static_cast<double>(s_dimension) + m_lambda);
+    const std::array<double, s_dimension> center = {mean.getOmegaM(), mean.getOmegaLambda(),
+                                                    mean.getHubbleConstant()};
+    std::array<CosmologicalParameters, s_point_count> points;
+    points[0] = mean;
+    for (std::size_t column = 0; column < s_dimension; ++column) {
+      std::array<double, s_dimension> plus = center, minus = center;
+      for (std::size_t row = column; row < s_dimension; ++row) {
+        plus[row] += scale * factor[row][column];
+        minus[row] -= scale * factor[row][column];
+      }
+      points[1 + column]               = CosmologicalParameters{plus[0], plus[1], plus[2]};
+      points[1 + s_dimension + column] = CosmologicalParameters{minus[0], minus[1], minus[2]};
+    }
+    return points;
+  }
+
+  /**
+   * @brief Mean and variance of a batch distance over the count redshifts of z
+   * @details batch(parameters, z, count, out) evaluates the distance for one cosmology, e.g. one of
+   *   the batch methods of CosmologicalDistances. mean_out and variance_out must hold count values.
+   */
+  template <typename BatchDistance>
+  void propagate(BatchDistance&& batch, const double* z, std::size_t count, const CosmologicalParameters& mean,
+                 const Covariance& covariance, double* mean_out, double* variance_out) const {
+    PHYSICSUTILS_TRACE_SCOPE("SigmaPointPropagation propagate", "quadrature");
+    const auto          points = sigmaPoints(mean, covariance);
+    std::vector<double> values(s_point_count * count);
+    for (std::size_t p = 0; p < s_point_count; ++p) {
+      batch(points[p], z, count, values.data() + p * count);
+    }
+    for (std::size_t i = 0; i < count; ++i) {
+      double average = 0.;
+      for (std::size_t p = 0; p < s_point_count; ++p) {
+        average += m_mean_weights[p] * values[p * count + i];
+      }
+      double variance = 0.;
+      for (std::size_t p = 0; p < s_point_count; ++p) {
+        const double deviation = values[p * count + i] - average;
+        variance += m_variance_weights[p] * deviation * deviation;
+      }
+      mean_out[i]     = average;
+      variance_out[i] = variance;
+    }
+  }
+
+  /**
+   * @name Distances of CosmologicalDistances
+   *
+   * The batch Romberg integrals of CosmologicalDistances converged to relative_precision, which
+   * should stay well below the relative spread of the distances.
+   * @{
+   */
+  void comovingDistance(const double* z, std::size_t count, const CosmologicalParameters& mean,
+                        const Covariance& covariance, double* mean_out, double* variance_out,
+                        double relative_precision = 0.0000001) const {
+    propagate(
+        [this, relative_precision](const CosmologicalParameters& parameters, const double* redshifts, std::size_t n,
+                                   double* out) {
+          m_distances.comovingDistance(redshifts, n, out, parameters, relative_precision);
+        },
+        z, count, mean, covariance, mean_out, variance_out);
+  }
+
+  void transverseComovingDistance(const double* z, std::size_t count, const CosmologicalParameters& mean,
+                                  const Covariance& covariance, double* mean_out, double* variance_out,
+                                  double relative_precision = 0.0000001) const {
+    propagate(
+        [this, relative_precision](const CosmologicalParameters& parameters, const double* redshifts, std::size_t n,
+                                   double* out) {
+          m_distances.transverseComovingDistance(redshifts, n, out, parameters, relative_precision);
+        },
+        z, count, mean, covariance, mean_out, variance_out);
+  }
+
+  void luminosityDistance(const double* z, std::size_t count, const CosmologicalParameters& mean,
+                          const Covariance& covariance, double* mean_out, double* variance_out,
+                          double relative_precision = 0.0000001) const {
+    propagate(
+        [this, relative_precision](const CosmologicalParameters& parameters, const double* redshifts, std::size_t n,
+                                   double* out) {
+          m_distances.luminosityDistance(redshifts, n, out, parameters, relative_precision);
+        },
+        z, count, mean, covariance, mean_out, variance_out);
+  }
+  /** @} */
+
+private:
+  /// Lower triangular L with L L^T = covariance, zero columns for the parameters without variance
+  static Covariance cholesky(const Covariance& covariance) {
+    for (std::size_t column = 0; column < s_dimension; ++column) {
+      for (std::size_t row = column + 1; row < s_dimension; ++row) {
+        if (covariance[row][column] != covariance[column][row]) {
+          throw std::invalid_argument("SigmaPointPropagation: the covariance is not symmetric");
+        }
+      }
+    }
+    Covariance factor{};
+    for (std::size_t column = 0; column < s_dimension; ++column) {
+      double pivot = covariance[column][column];
+      for (std::size_t k = 0; k < column; ++k) {
+        pivot -= factor[column][k] * factor[column][k];
+      }
+      const double tolerance = 1e-12 * std::abs(covariance[column][column]);
+      if (pivot < -tolerance || !std::isfinite(pivot)) {
+        throw std::invalid_argument("SigmaPointPropagation: the covariance is not positive semi-definite");
+      }
+      const bool degenerate = pivot <= tolerance;
+      if (!degenerate) {
+        factor[column][column] = std::sqrt(pivot);
+      }
+      for (std::size_t row = column + 1; row < s_dimension; ++row) {
+        double value = covariance[row][column];
+        for (std::size_t k = 0; k < column; ++k) {
+          value -= factor[row][k] * factor[column][k];
+        }
+        if (!degenerate) {
+          factor[row][column] = value / factor[column][column];
+        } else if (std::abs(value) > 1e-12 * std::sqrt(std::abs(covariance[row][row] * covariance[column][column]))) {
+          // A zero pivot needs the rest of its column to vanish too, [[0, 1], [1, 1]] is indefinite
+          throw std::invalid_argument("SigmaPointPropagation: the covariance is not positive semi-definite");
+        }
+      }
+    }
+    return factor;
+  }
+
+  double                            m_lambda;
+  std::array<double, s_point_count> m_mean_weights;
+  std::array<double, s_point_count> m_variance_weights;
+  CosmologicalDistances             m_distances;
+};
+
+}  // namespace PhysicsUtils
+}  // namespace Euclid
+#endif /* PHYSICSUTILS_PHYSICSUTILS_SIGMAPOINTPROPAGATION_H_ */
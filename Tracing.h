@@ -0,0 +1,304 @@
+/*
+ * Copyright (C) 2012-2021 Euclid Science Ground Segment
+ *
+ * This library is free software; you can redistribute it and/or modify it under
+ * the terms of the GNU Lesser General Public License as published by the Free
+ * Software Foundation; either version 3.0 of the License, or (at your option)
+ * any later version.
+ *
+ * This library is distributed in the hope that it will be useful, but WITHOUT
+ * ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS
+ * FOR A PARTICULAR PURPOSE. See the GNU Lesser General Public License for more
+ * details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with this library; if not, write to the Free Software Foundation, Inc.,
+ * 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA
+ */
+
+#ifndef PHYSICSUTILS_PHYSICSUTILS_TRACING_H_
+#define PHYSICSUTILS_PHYSICSUTILS_TRACING_H_
+
+#include <algorithm>
+#include <array>
+#include <atomic>
+#include <chrono>
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <mutex>
+#include <ostream>
+#include <vector>
+
+namespace Euclid {
+namespace PhysicsUtils {
+namespace Tracing {
+
+/// A complete (begin, end) event. name and category must have static storage duration.
+struct TraceEvent {
+  const char*   name;
+  const char*   category;
+  std::uint64_t begin_ns;
+  std::uint64_t end_ns;
+};
+
+/**
+ * @class TraceBuffer
+ *
+ * @brief Fixed size ring of events written by a single thread
+ *
+ * @details Only the owning thread writes; when the ring is full the oldest events are overwritten.
+ *   Each slot is a seqlock: its sequence number is odd while the writer fills it and 2 (n + 1)
+ *   once it holds the event number n. The fields are relaxed atomics, so the exporter reads the
+ *   ring without a lock and without a data race, and keeps an event only if the sequence number
+ *   of its slot was the expected one before and after the copy.
+ */
+class TraceBuffer {
+public:
+  static constexpr std::size_t s_capacity = 1 << 14;
+
+  explicit TraceBuffer(std::uint32_t thread_id) : m_thread_id{thread_id} {}
+
+  void push(const TraceEvent& event) {
+    const std::uint64_t head = m_head.load(std::memory_order_relaxed);
+    Slot&               slot = m_slots[head % s_capacity];
+    slot.sequence.store(2 * head + 1, std::memory_order_relaxed);
+    std::atomic_thread_fence(std::memory_order_release);
+    slot.name.store(event.name, std::memory_order_relaxed);
+    slot.category.store(event.category, std::memory_order_relaxed);
+    slot.begin_ns.store(event.begin_ns, std::memory_order_relaxed);
+    slot.end_ns.store(event.end_ns, std::memory_order_relaxed);
+    slot.sequence.store(2 * head + 2, std::memory_order_release);
+    m_head.store(head + 1, std::memory_order_release);
+  }
+
+  /// Append the events still held by the ring, oldest first
+  void collect(std::vector<TraceEvent>& events) const {
+    const std::uint64_t        head  = m_head.load(std::memory_order_acquire);
+    const std::uint64_t        first = head > s_capacity ? head - s_capacity : 0;
+    const std::size_t          start = events.size();
+    std::vector<std::uint64_t> numbers;
+    for (std::uint64_t i = first; i < head; ++i) {
+      const Slot&         slot     = m_slots[i % s_capacity];
+      const std::uint64_t expected = 2 * i + 2;
+      if (slot.sequence.load(std::memory_order_acquire) != expected) {
+        continue;
+      }
+      const TraceEvent event{slot.name.load(std::memory_order_relaxed), slot.category.load(std::memory_order_relaxed),
+                             slot.begin_ns.load(std::memory_order_relaxed),
+                             slot.end_ns.load(std::memory_order_relaxed)};
+      std::atomic_thread_fence(std::memory_order_acquire);
+      if (slot.sequence.load(std::memory_order_relaxed) == expected) {
+        events.push_back(event);
+        numbers.push_back(i);
+      }
+    }
+    // The writer may be filling event after - s_capacity's slot, drop it and everything older
+    const std::uint64_t after = m_head.load(std::memory_order_acquire);
+    if (after + 1 > s_capacity) {
+      const std::uint64_t oldest = after + 1 - s_capacity;
+      const auto lost = static_cast<std::ptrdiff_t>(std::lower_bound(numbers.begin(), numbers.end(), oldest) -
+                                                    numbers.begin());
+      events.erase(events.begin() + static_cast<std::ptrdiff_t>(start),
+                   events.begin() + static_cast<std::ptrdiff_t>(start) + lost);
+    }
+  }
+
+  std::uint32_t threadId() const {
+    return m_thread_id;
+  }
+
+private:
+  struct Slot {
+    std::atomic<std::uint64_t> sequence{0};
+    std::atomic<const char*>   name{nullptr};
+    std::atomic<const char*>   category{nullptr};
+    std::atomic<std::uint64_t> begin_ns{0};
+    std::atomic<std::uint64_t> end_ns{0};
+  };
+
+  std::array<Slot, s_capacity> m_slots{};
+  std::atomic<std::uint64_t>   m_head{0};
+  std::uint32_t                m_thread_id;
+};
+
+/**
+ * @class Tracer
+ *
+ * @brief Process wide registry of the per-thread trace buffers
+ *
+ * @details Recording is disabled by default and costs a single relaxed load per scope. A thread
+ *   gets a buffer on its first recorded event and hands it back to the registry when it exits.
+ *   The next thread to record reuses a returned buffer before a new one is allocated, so the
+ *   memory is bounded by the peak number of threads recording at the same time, not by the
+ *   number of threads ever started. The events of a finished thread stay exportable until the
+ *   new owner of its buffer overwrites them. The tid of the trace is that of the buffer: threads
+ *   that did not run at the same time may share one.
+ */
+class Tracer {
+public:
+  static Tracer& instance() {
+    static Tracer tracer;
+    return tracer;
+  }
+
+  void enable(bool enabled = true) {
+    m_enabled.store(enabled, std::memory_order_relaxed);
+  }
+
+  bool isEnabled() const {
+    return m_enabled.load(std::memory_order_relaxed);
+  }
+
+  std::uint64_t now() const {
+    return static_cast<std::uint64_t>(
+        std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now() - m_epoch).count());
+  }
+
+  void record(const char* name, const char* category, std::uint64_t begin_ns, std::uint64_t end_ns) {
+    threadBuffer().push(TraceEvent{name, category, begin_ns, end_ns});
+  }
+
+  /**
+   * @brief Write all the recorded events in the Chrome trace event format
+   * @details The output can be loaded in chrome://tracing or https://ui.perfetto.dev. It should be
+   *   called once the traced work is done; events recorded concurrently may or may not be included.
+   */
+  void exportChromeTrace(std::ostream& out) const {
+    std::vector<std::shared_ptr<TraceBuffer>> buffers;
+    {
+      std::lock_guard<std::mutex> lock{m_mutex};
+      buffers = m_buffers;
+    }
+    out << "{\"displayTimeUnit\":\"ns\",\"traceEvents\":[";
+    bool                    first = true;
+    std::vector<TraceEvent> events;
+    for (const auto& buffer : buffers) {
+      events.clear();
+      buffer->collect(events);
+      for (const auto& event : events) {
+        out << (first ? "\n" : ",\n");
+        first = false;
+        out << "{\"name\":";
+        writeString(out, event.name);
+        out << ",\"cat\":";
+        writeString(out, event.category);
+        out << ",\"ph\":\"X\",\"pid\":1,\"tid\":" << buffer->threadId() << ",\"ts\":";
+        writeMicroseconds(out, event.begin_ns);
+        out << ",\"dur\":";
+        writeMicroseconds(out, event.end_ns - event.begin_ns);
+        out << '}';
+      }
+    }
+    out << "\n]}\n";
+  }
+
+  /// Number of buffers allocated so far
+  std::size_t bufferCount() const {
+    std::lock_guard<std::mutex> lock{m_mutex};
+    return m_buffers.size();
+  }
+
+private:
+  /// The buffer of the calling thread, handed back to the registry when the thread exits
+  struct ThreadBuffer {
+    std::shared_ptr<TraceBuffer> buffer;
+
+    ~ThreadBuffer() {
+      if (buffer) {
+        Tracer::instance().release(std::move(buffer));
+      }
+    }
+  };
+
+  Tracer() : m_epoch{std::chrono::steady_clock::now()} {}
+
+  TraceBuffer& threadBuffer() {
+    thread_local ThreadBuffer owner;
+    if (!owner.buffer) {
+      std::lock_guard<std::mutex> lock{m_mutex};
+      if (!m_released.empty()) {
+        owner.buffer = std::move(m_released.back());
+        m_released.pop_back();
+      } else {
+        owner.buffer = std::make_shared<TraceBuffer>(static_cast<std::uint32_t>(m_buffers.size()));
+        m_buffers.push_back(owner.buffer);
+      }
+    }
+    return *owner.buffer;
+  }
+
+  /// Keep the buffer of an exiting thread for the next thread that records
+  void release(std::shared_ptr<TraceBuffer> buffer) {
+    std::lock_guard<std::mutex> lock{m_mutex};
+    m_released.push_back(std::move(buffer));
+  }
+
+  static void writeString(std::ostream& out, const char* value) {
+    out << '"';
+    for (const char* c = value; *c != '\0'; ++c) {
+      if (*c == '"' || *c == '\\') {
+        out << '\\';
+      }
+      out << *c;
+    }
+    out << '"';
+  }
+
+  /// The trace format counts in microseconds, keep the nanoseconds as three decimals
+  static void writeMicroseconds(std::ostream& out, std::uint64_t ns) {
+    const std::uint64_t fraction = ns % 1000;
+    out << ns / 1000 << '.' << fraction / 100 << fraction / 10 % 10 << fraction % 10;
+  }
+
+  std::chrono::steady_clock::time_point     m_epoch;
+  std::atomic<bool>                         m_enabled{false};
+  mutable std::mutex                        m_mutex;
+  std::vector<std::shared_ptr<TraceBuffer>> m_buffers;
+  /// Buffers of the exited threads, also in m_buffers
+  std::vector<std::shared_ptr<TraceBuffer>> m_released;
+};
+
+/// Record the lifetime of the object as an event, when the tracing is enabled
+class ScopedTrace {
+public:
+  ScopedTrace(const char* name, const char* category)
+    : m_name{name}, m_category{category}, m_enabled{Tracer::instance().isEnabled()} {
+    if (m_enabled) {
+      m_begin_ns = Tracer::instance().now();
+    }
+  }
+
+  ScopedTrace(const ScopedTrace&)            = delete;
+  ScopedTrace& operator=(const ScopedTrace&) = delete;
+
+  ~ScopedTrace() {
+    if (m_enabled) {
+      Tracer& tracer = Tracer::instance();
+      tracer.record(m_name, m_category, m_begin_ns, tracer.now());
+    }
+  }
+
+private:
+  const char*   m_name;
+  const char*   m_category;
+  bool          m_enabled;
+  std::uint64_t m_begin_ns{0};
+};
+
+}  // namespace Tracing
+}  // namespace PhysicsUtils
+}  // namespace Euclid
+
+#define PHYSICSUTILS_TRACE_CONCAT_IMPL(a, b) a##b
+#define PHYSICSUTILS_TRACE_CONCAT(a, b) PHYSICSUTILS_TRACE_CONCAT_IMPL(a, b)
+
+/// Trace the enclosing scope. Defining PHYSICSUTILS_NO_TRACING compiles the probes out.
+#ifdef PHYSICSUTILS_NO_TRACING
+#define PHYSICSUTILS_TRACE_SCOPE(name, category)
+#else
+#define PHYSICSUTILS_TRACE_SCOPE(name, category) \
+  ::Euclid::PhysicsUtils::Tracing::ScopedTrace PHYSICSUTILS_TRACE_CONCAT(physicsutils_trace_, __LINE__){name, category}
+#endif
+
+#endif /* PHYSICSUTILS_PHYSICSUTILS_TRACING_H_ */
@@ -0,0 +1,164 @@
+/*
+ * Copyright (C) 2012-2021 Euclid Science Ground Segment
+ *
+ * This library is free software; you can redistribute it and/or modify it under
+ * the terms of the GNU Lesser General Public License as published by the Free
+ * Software Foundation; either version 3.0 of the License, or (at your option)
+ * any later version.
+ *
+ * This library is distributed in the hope that it will be useful, but WITHOUT
+ * ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS
+ * FOR A PARTICULAR PURPOSE. See the GNU Lesser General Public License for more
+ * details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with this library; if not, write to the Free Software Foundation, Inc.,
+ * 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA
+ */
+
+#ifndef PHYSICSUTILS_PHYSICSUTILS_WORKLOADGENERATOR_H_
+#define PHYSICSUTILS_PHYSICSUTILS_WORKLOADGENERATOR_H_
+
+#include "CosmologicalParameters.h"
+#include <algorithm>
+#include <cmath>
+#include <cstddef>
+#include <cstdint>
+#include <random>
+#include <vector>
+
+namespace Euclid {
+namespace PhysicsUtils {
+
+/**
+ * @brief Shape of a redshift stream
+ * @details The redshifts follow the Smail et al. distribution
+ *   \f$n(z) \propto z^\alpha \exp(-(z/z_0)^\beta)\f$, truncated at z_max. The defaults are the
+ *   Euclid wide survey ones.
+ */
+struct RedshiftStreamOptions {
+  double alpha{2.};
+  double beta{1.5};
+  double z_0{0.9 / std::sqrt(2.)};
+  double z_max{6.};
+  /// Return the redshifts in increasing order, as after a sort by redshift of the catalog
+  bool sorted{false};
+  /// Fraction of the objects repeating the redshift of a previous one, as for binned photo-z
+  double duplicate_fraction{0.};
+};
+
+/**
+ * @brief Mix of cosmologies around a fiducial one
+ * @details flat_fraction of the cosmologies are nominally flat, with \f$\Omega_\Lambda = 1 - \Omega_m\f$
+ *   up to round-off, the others draw \f$\Omega_\Lambda\f$ independently so that \f$\Omega_k\f$ is spread
+ *   by about sigma_omega_lambda.
+ */
+struct CosmologyMixOptions {
+  CosmologicalParameters fiducial{};
+  double                 flat_fraction{0.5};
+  double                 sigma_omega_m{0.02};
+  double                 sigma_omega_lambda{0.02};
+  double                 sigma_hubble_constant{1.};
+};
+
+/**
+ * @class WorkloadGenerator
+ *
+ * @brief Reproducible synthetic survey-like inputs for the benchmarks
+ *
+ * @details All the streams are drawn from a single 64 bits Mersenne twister, so that the same seed
+ *   and the same sequence of calls always produce the same workload.
+ */
+class WorkloadGenerator {
+public:
+  explicit WorkloadGenerator(std::uint64_t seed = 42) : m_engine{seed} {}
+
+  /// Draw count redshifts following the survey n(z)
+  std::vector<double> redshifts(std::size_t count, const RedshiftStreamOptions& options = {}) {
+    // With x = (z / z_0)^beta, the Smail distribution is a Gamma((alpha + 1) / beta, 1) in x
+    std::gamma_distribution<double>        gamma{(options.alpha + 1.) / options.beta, 1.};
+    std::uniform_real_distribution<double> uniform{0., 1.};
+    std::vector<double>                    z(count);
+    for (std::size_t i = 0; i < count; ++i) {
+      if (i > 0 && uniform(m_engine) < options.duplicate_fraction) {
+        z[i] = z[std::uniform_int_distribution<std::size_t>{0, i - 1}(m_engine)];
+        continue;
+      }
+      do {
+        z[i] = options.z_0 * std::pow(gamma(m_engine), 1. / options.beta);
+      } while (z[i] > options.z_max);
+    }
+    if (options.sorted) {
+      std::sort(z.begin(), z.end());
+    }
+    return z;
+  }
+
+  /**
+   * @brief Draw samples_per_object redshifts per object from a Gaussian photo-z PDF
+   * @details The PDF of each object is centered on its true redshift with a width of
+   *   sigma_0 (1 + z), and samples are clipped at 0. The samples of an object are contiguous.
+   */
+  std::vector<double> photometricRedshifts(const std::vector<double>& true_redshifts, std::size_t samples_per_object,
+                                           double sigma_0 = 0.05) {
+    std::normal_distribution<double> normal{0., 1.};
+    std::vector<double>              z;
+    z.reserve(true_redshifts.size() * samples_per_object);
+    for (double z_true : true_redshifts) {
+      for (std::size_t s = 0; s < samples_per_object; ++s) {
+        z.push_back(std::max(0., z_true + sigma_0 * (1. + z_true) * normal(m_engine)));
+      }
+    }
+    return z;
+  }
+
+  /// Draw count independent cosmologies, flat or curved
+  std::vector<CosmologicalParameters> cosmologies(std::size_t count, const CosmologyMixOptions& options = {}) {
+    std::normal_distribution<double>       normal{0., 1.};
+    std::uniform_real_distribution<double> uniform{0., 1.};
+    std::vector<CosmologicalParameters>    result;
+    result.reserve(count);
+    for (std::size_t i = 0; i < count; ++i) {
+      const double omega_m = options.fiducial.getOmegaM() + options.sigma_omega_m * normal(m_engine);
+      const double h_0 = options.fiducial.getHubbleConstant() + options.sigma_hubble_constant * normal(m_engine);
+      const double omega_lambda = uniform(m_engine) < options.flat_fraction
+                                      ? 1. - omega_m
+                                      : options.fiducial.getOmegaLambda() + options.sigma_omega_lambda * normal(m_engine);
+      result.emplace_back(omega_m, omega_lambda, h_0);
+    }
+    return result;
+  }
+
+  /**
+   * @brief A Metropolis-like chain of count cosmologies
+   * @details Each step proposes a Gaussian jump of the given widths and is rejected with
+   *   probability rejection_rate, in which case the previous cosmology is repeated, as in the
+   *   output of an MCMC sampler. Flat chains keep \f$\Omega_\Lambda = 1 - \Omega_m\f$.
+   */
+  std::vector<CosmologicalParameters> randomWalk(std::size_t count, const CosmologyMixOptions& options = {},
+                                                 bool flat = true, double rejection_rate = 0.75) {
+    std::normal_distribution<double>       normal{0., 1.};
+    std::uniform_real_distribution<double> uniform{0., 1.};
+    std::vector<CosmologicalParameters>    result;
+    result.reserve(count);
+    double omega_m      = options.fiducial.getOmegaM();
+    double omega_lambda = flat ? 1. - omega_m : options.fiducial.getOmegaLambda();
+    double h_0          = options.fiducial.getHubbleConstant();
+    for (std::size_t i = 0; i < count; ++i) {
+      if (i > 0 && uniform(m_engine) >= rejection_rate) {
+        omega_m      = std::max(0.01, omega_m + options.sigma_omega_m * normal(m_engine));
+        omega_lambda = flat ? 1. - omega_m : omega_lambda + options.sigma_omega_lambda * normal(m_engine);
+        h_0 += options.sigma_hubble_constant * normal(m_engine);
+      }
+      result.emplace_back(omega_m, omega_lambda, h_0);
+    }
+    return result;
+  }
+
+private:
+  std::mt19937_64 m_engine;
+};
+
+}  // namespace PhysicsUtils
+}  // namespace Euclid
+#endif /* PHYSICSUTILS_PHYSICSUTILS_WORKLOADGENERATOR_H_ */
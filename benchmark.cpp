@@ -0,0 +1,159 @@
+#include <chrono>
+#include <cstdlib>
+#include <iomanip>
+#include <iostream>
+#include <string>
+#include <vector>
+#include "CertifiedDistances.h"
+#include "CosmologicalDistances.h"
+#include "CosmologicalParameters.h"
+#include "DistanceMatrix.h"
+#include "DistanceTableCache.h"
+#include "ParallelDistances.h"
+#include "WorkloadGenerator.h"
+
+using namespace Euclid::PhysicsUtils;
+
+namespace {
+
+// Keeps the results alive so that the compiler cannot drop the timed loops
+double g_sink = 0.;
+
+template <typename Function>
+void report(const std::string& name, std::size_t count, Function&& function) {
+  auto start = std::chrono::steady_clock::now();
+  function();
+  auto   stop    = std::chrono::steady_clock::now();
+  double seconds = std::chrono::duration<double>(stop - start).count();
+  std::cout << std::left << std::setw(40) << name << std::right << std::setw(12) << std::fixed << std::setprecision(2)
+            << seconds * 1e9 / static_cast<double>(count) << " ns/object" << std::setw(12)
+            << static_cast<double>(count) / seconds * 1e-6 << " Mobject/s" << std::endl;
+}
+
+void runStream(const std::string& name, const std::vector<double>& z, const CosmologicalParameters& parameters,
+               DistanceTableCache& cache) {
+  CosmologicalDistances         distances{};
+  const QuadratureConvergence<> converged{};
+  std::vector<double>           out(z.size());
+
+  report(name + " scalar", z.size(), [&] {
+    for (std::size_t i = 0; i < z.size(); ++i) {
+      out[i] = distances.transverseComovingDistance(z[i], parameters, converged);
+    }
+    g_sink += out.back();
+  });
+  report(name + " batch", z.size(), [&] {
+    distances.transverseComovingDistance(z.data(), z.size(), out.data(), parameters);
+    g_sink += out.back();
+  });
+  auto table = cache.table(parameters);
+  report(name + " table", z.size(), [&] {
+    (*table)(z.data(), z.size(), out.data());
+    g_sink += out.back();
+  });
+}
+
+}  // namespace
+
+int main(int argc, char* argv[]) {
+  std::size_t count = argc > 1 ? std::strtoul(argv[1], nullptr, 10) : 100000;
+  if (count == 0) {
+    std::cerr << "Usage: " << argv[0] << " [objects > 0]" << std::endl;
+    return 1;
+  }
+
+  WorkloadGenerator  generator{};
+  DistanceTableCache cache{};
+  const CosmologicalParameters fiducial{};
+
+  RedshiftStreamOptions survey{};
+  runStream("survey n(z), unsorted", generator.redshifts(count, survey), fiducial, cache);
+
+  RedshiftStreamOptions sorted{};
+  sorted.sorted = true;
+  runStream("survey n(z), sorted", generator.redshifts(count, sorted), fiducial, cache);
+
+  RedshiftStreamOptions duplicated{};
+  duplicated.duplicate_fraction = 0.5;
+  runStream("survey n(z), 50% duplicated", generator.redshifts(count, duplicated), fiducial, cache);
+
+  auto photo_z = generator.photometricRedshifts(generator.redshifts(count / 100 + 1, survey), 100);
+  runStream("photo-z PDF, 100 samples", photo_z, fiducial, cache);
+
+  // One cosmology per chain step and a fixed redshift grid, as in a likelihood evaluation
+  for (bool flat : {true, false}) {
+    auto        chain = generator.randomWalk(1000, CosmologyMixOptions{}, flat);
+    auto        z     = generator.redshifts(count / chain.size() + 1, sorted);
+    std::string name  = flat ? "MCMC chain, flat" : "MCMC chain, curved";
+    std::vector<double> out(z.size());
+    report(name + " table", chain.size() * z.size(), [&] {
+      for (const auto& parameters : chain) {
+        (*cache.table(parameters))(z.data(), z.size(), out.data());
+        g_sink += out.back();
+      }
+    });
+  }
+
+  // Dense cosmology x redshift matrix, as for an emulator training set
+  {
+    auto                cosmologies = generator.cosmologies(count / 1000 + 1, CosmologyMixOptions{});
+    auto                z           = generator.redshifts(1000, survey);
+    std::vector<double> comoving(cosmologies.size() * z.size()), transverse(comoving.size()), hubble(comoving.size());
+    report("cosmology x redshift matrix", comoving.size(), [&] {
+      DistanceMatrix matrix{z.data(), z.size()};
+      matrix.evaluate(cosmologies, DistanceMatrixOutput{comoving.data(), transverse.data(), hubble.data()});
+      g_sink += transverse.back();
+    });
+  }
+
+  // Certified enclosures against the Romberg quadrature at the same default precision
+  {
+    auto                  z = generator.redshifts(count, survey);
+    std::vector<double>   out(z.size());
+    std::vector<Interval> bounds(z.size());
+    report("Romberg comoving, 1e-7", z.size(), [&] {
+      CosmologicalDistances distances{};
+      for (std::size_t i = 0; i < z.size(); ++i) {
+        out[i] = distances.comovingDistance(z[i], fiducial, QuadratureConvergence<>{1e-7});
+      }
+      g_sink += out.empty() ? 0. : out.back();
+    });
+    report("certified comoving enclosure", z.size(), [&] {
+      CertifiedDistances{}.comovingDistance(z.data(), z.size(), bounds.data(), fiducial);
+      g_sink += bounds.empty() ? 0. : bounds.back().upper();
+    });
+  }
+
+  // Summary statistics of the distances, through an output array or streamed into the accumulators
+  {
+    auto                  z = generator.redshifts(count, survey);
+    std::vector<double>   out(z.size());
+    InlineExecutor        serial;
+    ParallelDistances     parallel{serial};
+    const DistanceSummary empty{DistanceHistogram{0., 10000., 100}};
+    report("histogram and moments, materialized", z.size(), [&] {
+      DistanceSummary summary = empty;
+      parallel.comovingDistance(z.data(), z.size(), out.data(), fiducial);
+      for (double distance : out) {
+        summary.add(distance);
+      }
+      g_sink += summary.moments.getMean();
+    });
+    report("histogram and moments, streamed", z.size(), [&] {
+      auto summary = parallel.aggregate(DistanceKind::Comoving, z.data(), nullptr, z.size(), fiducial, empty);
+      g_sink += summary.moments.getMean();
+    });
+  }
+
+  auto mix = generator.cosmologies(count, CosmologyMixOptions{});
+  auto z   = generator.redshifts(count, survey);
+  report("cosmology mix, one object each", count, [&] {
+    CosmologicalDistances         distances{};
+    const QuadratureConvergence<> converged{};
+    for (std::size_t i = 0; i < count; ++i) {
+      g_sink += distances.transverseComovingDistance(z[i], mix[i], converged);
+    }
+  });
+
+  return g_sink == 0. ? 1 : 0;
+}
@@ -0,0 +1,106 @@
+#!/usr/bin/env python3
+"""Read back Arrow outputs of ArrowWriter / IncrementalDistances with pyarrow and check their values.
+
+Usage: check_arrow.py [--omega-m OM] [--omega-lambda OL] [--h0 H0] [--tolerance T] [--samples N] FILE [FILE ...]
+
+Files ending in .arrows are read as the Arrow stream format, the others as the
+file format. The cosmology must be the one the files were written with, the
+CosmologicalParameters defaults unless given. For up to N rows of each file,
+the comoving distance is compared with an independent Simpson integration
+within the relative tolerance T, the transverse distance with the curvature
+formula of that comoving distance, and the luminosity distance must be
+exactly (1 + z) times the transverse one.
+
+pyarrow is not installed by this script: install it first, e.g. with
+pip install pyarrow.
+"""
+
+import argparse
+import math
+import sys
+
+try:
+    import pyarrow as pa
+except ImportError:
+    sys.exit("check_arrow.py: pyarrow is required to read the Arrow files, install it first (pip install pyarrow)")
+
+EXPECTED = ["z", "comoving", "transverse", "luminosity"]
+SPEED_OF_LIGHT = 299792.458
+
+
+class Cosmology:
+    def __init__(self, omega_m, omega_lambda, h0):
+        self.omega_m = omega_m
+        self.omega_lambda = omega_lambda
+        self.omega_k = 1.0 - omega_m - omega_lambda
+        self.hubble_distance = SPEED_OF_LIGHT / h0
+
+    def inverse_hubble(self, z):
+        x = 1.0 + z
+        return 1.0 / math.sqrt((self.omega_m * x + self.omega_k) * x * x + self.omega_lambda)
+
+    def comoving(self, z):
+        """Composite Simpson rule, fine enough for a relative error far below 1e-9"""
+        intervals = 2 * max(64, math.ceil(abs(z) * 200))
+        step = z / intervals
+        total = self.inverse_hubble(0.0) + self.inverse_hubble(z)
+        for i in range(1, intervals):
+            total += (4.0 if i % 2 else 2.0) * self.inverse_hubble(i * step)
+        return self.hubble_distance * total * step / 3.0
+
+    def transverse(self, comoving):
+        if self.omega_k == 0.0:
+            return comoving
+        root = math.sqrt(abs(self.omega_k))
+        x = root * comoving / self.hubble_distance
+        curved = math.sinh(x) if self.omega_k > 0.0 else math.sin(x)
+        return self.hubble_distance / root * curved
+
+
+def close(value, reference, tolerance):
+    return abs(value - reference) <= tolerance * abs(reference)
+
+
+def check(path, cosmology, tolerance, samples):
+    if path.endswith(".arrows"):
+        table = pa.ipc.open_stream(path).read_all()
+    else:
+        table = pa.ipc.open_file(path).read_all()
+    if table.schema.names[: len(EXPECTED)] != EXPECTED:
+        sys.exit(f"{path}: unexpected columns {table.schema.names}")
+    for field in table.schema:
+        if field.type != pa.float64():
+            sys.exit(f"{path}: column {field.name} is {field.type}, not double")
+
+    columns = {name: table.column(name).to_pylist() for name in EXPECTED}
+    stride = max(1, table.num_rows // samples) if samples > 0 else max(1, table.num_rows)
+    failures = 0
+    for row in range(0, table.num_rows, stride):
+        z, comoving, transverse, luminosity = (columns[name][row] for name in EXPECTED)
+        problems = []
+        if not close(comoving, cosmology.comoving(z), tolerance):
+            problems.append(f"comoving {comoving!r} != {cosmology.comoving(z)!r}")
+        if not close(transverse, cosmology.transverse(comoving), tolerance):
+            problems.append(f"transverse {transverse!r} != {cosmology.transverse(comoving)!r}")
+        if luminosity != (1.0 + z) * transverse:
+            problems.append(f"luminosity {luminosity!r} != (1 + z) transverse {(1.0 + z) * transverse!r}")
+        if problems:
+            failures += 1
+            print(f"{path}: row {row} at z = {z!r}: " + ", ".join(problems), file=sys.stderr)
+    if failures:
+        sys.exit(f"{path}: {failures} row(s) do not match the distances")
+    print(f"{path}: {table.num_rows} rows, {table.num_columns} columns, values checked every {stride} row(s)")
+
+
+if __name__ == "__main__":
+    parser = argparse.ArgumentParser(usage=__doc__)
+    parser.add_argument("--omega-m", type=float, default=0.3089)
+    parser.add_argument("--omega-lambda", type=float, default=0.6911)
+    parser.add_argument("--h0", type=float, default=67.74)
+    parser.add_argument("--tolerance", type=float, default=1e-6)
+    parser.add_argument("--samples", type=int, default=1000)
+    parser.add_argument("files", nargs="+")
+    arguments = parser.parse_args()
+    cosmology = Cosmology(arguments.omega_m, arguments.omega_lambda, arguments.h0)
+    for name in arguments.files:
+        check(name, cosmology, arguments.tolerance, arguments.samples)
@@ -0,0 +1,295 @@
+#include <algorithm>
+#include <array>
+#include <atomic>
+#include <cmath>
+#include <cstdlib>
+#include <iostream>
+#include <limits>
+#include <stdexcept>
+#include <sstream>
+#include <string>
+#include <thread>
+#include <utility>
+#include <vector>
+#include "CertifiedDistances.h"
+#include "ComovingDistanceTable.h"
+#include "ComovingPositions.h"
+#include "CosmologicalDistances.h"
+#include "CosmologicalParameters.h"
+#include "DistanceMatrix.h"
+#include "DistanceTableCache.h"
+#include "SigmaPointPropagation.h"
+#include "Tracing.h"
+
+using namespace Euclid::PhysicsUtils;
+
+namespace {
+
+int g_failures = 0;
+
+void check(bool condition, const std::string& name) {
+  if (!condition) {
+    std::cerr << "FAILED: " << name << std::endl;
+    ++g_failures;
+  }
+}
+
+bool near(double value, double reference, double relative_tolerance) {
+  return std::abs(value - reference) <= relative_tolerance * std::abs(reference);
+}
+
+/// Flat, open and closed
+const std::vector<CosmologicalParameters> s_cosmologies{
+    CosmologicalParameters{}, CosmologicalParameters{0.25, 0.6, 70.}, CosmologicalParameters{0.35, 0.75, 70.}};
+
+std::vector<double> redshifts() {
+  std::vector<double> z{0., 0.001};
+  for (int i = 1; i <= 120; ++i) {
+    z.push_back(0.05 * i);
+  }
+  return z;
+}
+
+/// The batch API is the scalar Romberg integral per object, and both are within tolerance of a tight one
+void checkBatchAgainstScalar() {
+  const CosmologicalDistances distances{};
+  const std::vector<double>   z = redshifts();
+  std::vector<double>         comoving(z.size()), transverse(z.size()), luminosity(z.size());
+  for (const auto& parameters : s_cosmologies) {
+    distances.comovingDistance(z.data(), z.size(), comoving.data(), parameters);
+    distances.transverseComovingDistance(z.data(), z.size(), transverse.data(), parameters);
+    distances.luminosityDistance(z.data(), z.size(), luminosity.data(), parameters);
+    for (std::size_t i = 0; i < z.size(); ++i) {
+      const std::string at = " at z = " + std::to_string(z[i]);
+      check(comoving[i] == distances.comovingDistance(z[i], parameters), "batch D_C is the scalar D_C" + at);
+      check(transverse[i] == distances.transverseComovingDistance(z[i], parameters, QuadratureConvergence<>{}),
+            "batch D_M is the scalar D_M" + at);
+      check(luminosity[i] == distances.luminosityDistance(z[i], parameters), "batch D_L is the scalar D_L" + at);
+
+      const double reference = distances.comovingDistance(z[i], parameters, QuadratureConvergence<>{1e-13});
+      check(near(comoving[i], reference, 1e-6), "batch D_C within 1e-6 of the converged integral" + at);
+    }
+  }
+}
+
+/// The overloads with errors give the plain distances, with and without error columns
+void checkErrorsAgainstPlain() {
+  const CosmologicalDistances distances{};
+  const std::vector<double>   z = redshifts();
+  const std::vector<double>   sigma_z(z.size(), 0.01);
+  std::vector<double>         plain(z.size()), none(z.size()), with(z.size()), derivative(z.size()), sigma(z.size());
+  const DistanceErrors        errors{derivative.data(), sigma_z.data(), sigma.data()};
+  for (const auto& parameters : s_cosmologies) {
+    for (int kind = 0; kind < 3; ++kind) {
+      const std::string name = kind == 0 ? "D_C" : kind == 1 ? "D_M" : "D_L";
+      if (kind == 0) {
+        distances.comovingDistance(z.data(), z.size(), plain.data(), parameters);
+        distances.comovingDistance(z.data(), z.size(), none.data(), parameters, DistanceErrors{});
+        distances.comovingDistance(z.data(), z.size(), with.data(), parameters, errors);
+      } else if (kind == 1) {
+        distances.transverseComovingDistance(z.data(), z.size(), plain.data(), parameters);
+        distances.transverseComovingDistance(z.data(), z.size(), none.data(), parameters, DistanceErrors{});
+        distances.transverseComovingDistance(z.data(), z.size(), with.data(), parameters, errors);
+      } else {
+        distances.luminosityDistance(z.data(), z.size(), plain.data(), parameters);
+        distances.luminosityDistance(z.data(), z.size(), none.data(), parameters, DistanceErrors{});
+        distances.luminosityDistance(z.data(), z.size(), with.data(), parameters, errors);
+      }
+      for (std::size_t i = 0; i < z.size(); ++i) {
+        const std::string at = " at z = " + std::to_string(z[i]);
+        check(plain[i] == none[i], "plain " + name + " is the one with DistanceErrors{}" + at);
+        check(plain[i] == with[i], "plain " + name + " is the one with error columns" + at);
+        check(sigma[i] == std::abs(derivative[i]) * sigma_z[i], "sigma of " + name + " is |dD/dz| sigma_z" + at);
+      }
+    }
+  }
+}
+
+/// The sigma points match the linear propagation J C J^T of a small covariance, J by central differences
+void checkSigmaPointsAgainstLinear() {
+  const CosmologicalDistances             distances{};
+  const SigmaPointPropagation             propagation{};
+  const std::array<double, 3>             center{0.3, 0.7, 70.};
+  const CosmologicalParameters            mean{center[0], center[1], center[2]};
+  const SigmaPointPropagation::Covariance covariance{{{1e-4, -4e-5, 0.}, {-4e-5, 1e-4, 0.}, {0., 0., 0.25}}};
+  const std::array<double, 3>             steps{1e-4, 1e-4, 1e-2};
+  const std::vector<double>               z{0.1, 0.5, 1., 2., 4.};
+  std::vector<double>                     mean_out(z.size()), variance_out(z.size());
+  propagation.luminosityDistance(z.data(), z.size(), mean, covariance, mean_out.data(), variance_out.data(), 1e-10);
+  for (std::size_t i = 0; i < z.size(); ++i) {
+    const auto shifted = [&](std::size_t k, double step) {
+      std::array<double, 3> point = center;
+      point[k] += step;
+      return distances.luminosityDistance(z[i], CosmologicalParameters{point[0], point[1], point[2]}, 1e-12);
+    };
+    std::array<double, 3> jacobian{};
+    for (std::size_t k = 0; k < 3; ++k) {
+      jacobian[k] = (shifted(k, steps[k]) - shifted(k, -steps[k])) / (2. * steps[k]);
+    }
+    double linear = 0.;
+    for (std::size_t row = 0; row < 3; ++row) {
+      for (std::size_t column = 0; column < 3; ++column) {
+        linear += jacobian[row] * covariance[row][column] * jacobian[column];
+      }
+    }
+    const std::string at = " at z = " + std::to_string(z[i]);
+    check(near(mean_out[i], distances.luminosityDistance(z[i], mean, 1e-12), 1e-3), "sigma point mean of D_L" + at);
+    check(linear > 0. && near(variance_out[i], linear, 1e-2), "sigma point variance of D_L" + at);
+  }
+}
+
+/// The positions lie at the Romberg comoving distance in the direction of (RA, Dec)
+void checkPositionsAgainstRomberg() {
+  const CosmologicalDistances  distances{};
+  const CosmologicalParameters parameters{0.25, 0.6, 70.};
+  const ComovingPositions      positions{parameters};
+  const std::vector<double>    z = redshifts();
+  std::vector<double>          right_ascension(z.size()), declination(z.size());
+  for (std::size_t i = 0; i < z.size(); ++i) {
+    right_ascension[i] = 3. * static_cast<double>(i);
+    declination[i]     = -80. + static_cast<double>(i);
+  }
+  const std::vector<Position> out = positions(right_ascension, declination, z);
+  for (std::size_t i = 0; i < z.size(); ++i) {
+    const double radius = std::sqrt(out[i][0] * out[i][0] + out[i][1] * out[i][1] + out[i][2] * out[i][2]);
+    check(std::abs(radius - distances.comovingDistance(z[i], parameters)) <= 1e-9 * (1. + radius),
+          "position radius is D_C at z = " + std::to_string(z[i]));
+  }
+}
+
+template <typename Function>
+bool throwsInvalidArgument(Function&& function) {
+  try {
+    function();
+  } catch (const std::invalid_argument&) {
+    return true;
+  }
+  return false;
+}
+
+/// The interpolated table stays within its linear interpolation error of the Romberg integral
+void checkTableAgainstRomberg() {
+  const CosmologicalDistances distances{};
+  for (const auto& parameters : s_cosmologies) {
+    const ComovingDistanceTable table{distances, parameters};
+    double                      worst = 0.;
+    for (int i = 1; i <= 1000; ++i) {
+      const double z         = 0.0097 * i;
+      const double reference = distances.comovingDistance(z, parameters, QuadratureConvergence<>{1e-12});
+      worst                  = std::max(worst, std::abs(table(z) - reference) / reference);
+    }
+    check(worst < 1e-5, "default table within 1e-5 of the Romberg D_C, worst " + std::to_string(worst));
+  }
+
+  const double nan = std::numeric_limits<double>::quiet_NaN();
+  for (const auto& geometry : {std::make_pair(10., std::size_t{1}), std::make_pair(10., std::size_t{0}),
+                               std::make_pair(0., std::size_t{16}), std::make_pair(-1., std::size_t{16}),
+                               std::make_pair(nan, std::size_t{16})}) {
+    const std::string name = " for z_max = " + std::to_string(geometry.first) +
+                             ", size = " + std::to_string(geometry.second);
+    check(throwsInvalidArgument([&] {
+            ComovingDistanceTable{distances, CosmologicalParameters{}, geometry.first, geometry.second};
+          }),
+          "table geometry rejected" + name);
+    check(throwsInvalidArgument([&] { DistanceTableCache{0, geometry.first, geometry.second}; }),
+          "cache geometry rejected" + name);
+  }
+
+  // The cancellable build is the constructor in blocks, and gives up once stopped
+  std::atomic<bool> stop{false};
+  const auto        built = ComovingDistanceTable::build(distances, CosmologicalParameters{}, 10., 1000, 1e-7, stop);
+  const ComovingDistanceTable constructed{distances, CosmologicalParameters{}, 10., 1000};
+  check(built != nullptr && std::equal(constructed.data(), constructed.data() + 1000, built->data()),
+        "build() gives the nodes of the constructor");
+  stop = true;
+  check(ComovingDistanceTable::build(distances, CosmologicalParameters{}, 10., 1000, 1e-7, stop) == nullptr,
+        "build() stops once asked to");
+}
+
+/// The certified enclosures contain the converged Romberg integral, and stay finite for any finite z
+void checkCertifiedAgainstRomberg() {
+  const CosmologicalDistances distances{};
+  const CertifiedDistances    certified{};
+  const std::vector<double>   z = redshifts();
+  std::vector<Interval>       bounds(z.size());
+  for (const auto& parameters : s_cosmologies) {
+    certified.transverseComovingDistance(z.data(), z.size(), bounds.data(), parameters);
+    for (std::size_t i = 0; i < z.size(); ++i) {
+      const double reference =
+          distances.transverseComovingDistance(z[i], parameters, QuadratureConvergence<>{1e-13}, 1e-13);
+      check(bounds[i].lower() <= reference && reference <= bounds[i].upper(),
+            "certified D_M contains the Romberg one at z = " + std::to_string(z[i]));
+    }
+    const Interval far = certified.comovingDistance(1e300, parameters);
+    check(std::isfinite(far.lower()) && std::isfinite(far.upper()) && far.upper() - far.lower() < 1e-5 * far.upper(),
+          "certified D_C finite and tight at z = 1e300");
+  }
+  check(throwsInvalidArgument([] { CertifiedDistances{0.}; }), "certified panel width 0 rejected");
+  check(throwsInvalidArgument([] { CertifiedDistances{std::numeric_limits<double>::infinity()}; }),
+        "certified infinite panel width rejected");
+}
+
+/// The matrix agrees with the Romberg integral and rejects the redshifts it cannot sort or integrate
+void checkMatrixAgainstRomberg() {
+  const CosmologicalDistances distances{};
+  std::vector<double>         z = redshifts();
+  std::reverse(z.begin(), z.end());
+  const DistanceMatrix matrix{z.data(), z.size()};
+  std::vector<double>  comoving(s_cosmologies.size() * z.size());
+  matrix.evaluate(s_cosmologies, DistanceMatrixOutput{comoving.data(), nullptr, nullptr});
+  for (std::size_t c = 0; c < s_cosmologies.size(); ++c) {
+    for (std::size_t i = 0; i < z.size(); ++i) {
+      const double reference = distances.comovingDistance(z[i], s_cosmologies[c], QuadratureConvergence<>{1e-13});
+      check(std::abs(comoving[c * z.size() + i] - reference) <= 1e-9 * (1. + reference),
+            "matrix D_C is the Romberg one at z = " + std::to_string(z[i]));
+    }
+  }
+
+  for (double bad : {-0.5, std::numeric_limits<double>::quiet_NaN(), std::numeric_limits<double>::infinity()}) {
+    const std::vector<double> grid{0.5, bad, 1.};
+    check(throwsInvalidArgument([&] { DistanceMatrix{grid.data(), grid.size()}; }),
+          "matrix rejects z = " + std::to_string(bad));
+  }
+}
+
+/// Threads started one after the other reuse the same trace buffer, and their events are all exported
+void checkTraceBufferRecycling() {
+  Tracing::Tracer& tracer = Tracing::Tracer::instance();
+  tracer.enable();
+  const std::size_t before = tracer.bufferCount();
+  for (int i = 0; i < 100; ++i) {
+    std::thread{[] {
+      PHYSICSUTILS_TRACE_SCOPE("checkTraceBufferRecycling", "check");
+    }}.join();
+  }
+  tracer.enable(false);
+  check(tracer.bufferCount() <= before + 1, "sequential threads share one trace buffer");
+  std::ostringstream out;
+  tracer.exportChromeTrace(out);
+  const std::string trace  = out.str();
+  std::size_t       events = 0;
+  for (std::size_t at = trace.find("checkTraceBufferRecycling"); at != std::string::npos;
+       at = trace.find("checkTraceBufferRecycling", at + 1)) {
+    ++events;
+  }
+  check(events == 100, "the events of the exited threads are exported, " + std::to_string(events) + " of 100");
+}
+
+}  // namespace
+
+int main() {
+  checkBatchAgainstScalar();
+  checkErrorsAgainstPlain();
+  checkSigmaPointsAgainstLinear();
+  checkPositionsAgainstRomberg();
+  checkTableAgainstRomberg();
+  checkCertifiedAgainstRomberg();
+  checkMatrixAgainstRomberg();
+  checkTraceBufferRecycling();
+  if (g_failures > 0) {
+    std::cerr << g_failures << " check(s) failed" << std::endl;
+    return EXIT_FAILURE;
+  }
+  std::cout << "All checks passed" << std::endl;
+  return EXIT_SUCCESS;
+}
@@ -0,0 +1,158 @@
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <fstream>
+#include <iomanip>
+#include <iostream>
+#include <string>
+#include <vector>
+#include <spawn.h>
+#include <sys/wait.h>
+#include <unistd.h>
+#include "ComovingDistanceTable.h"
+#include "CosmologicalDistances.h"
+#include "CosmologicalParameters.h"
+#include "FastStartDistances.h"
+
+extern char** environ;
+
+using namespace Euclid::PhysicsUtils;
+
+namespace {
+
+const double                 s_z = 1.5;
+const CosmologicalParameters s_parameters{};
+
+std::int64_t now() {
+  // steady_clock is CLOCK_MONOTONIC, so the parent and the child timestamps can be compared
+  return std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now().time_since_epoch())
+      .count();
+}
+
+/// Child side: reach the first distance with the given strategy and report the timings
+int child(const std::string& mode, std::int64_t spawn_ns, const char* table_path) {
+  double       first      = 0.;
+  std::int64_t first_ns   = 0;
+  std::int64_t precise_ns = 0;
+  if (mode == "direct") {
+    first    = CosmologicalDistances{}.comovingDistance(s_z, s_parameters);
+    first_ns = precise_ns = now();
+  } else if (mode == "table-build") {
+    ComovingDistanceTable table{CosmologicalDistances{}, s_parameters};
+    first    = table(s_z);
+    first_ns = precise_ns = now();
+  } else if (mode == "table-load") {
+    std::ifstream file{table_path, std::ios::binary};
+    auto          table = ComovingDistanceTable::load(file);
+    first               = table(s_z);
+    first_ns = precise_ns = now();
+  } else if (mode == "fast-start") {
+    FastStartDistances distances{s_parameters};
+    first    = distances.comovingDistance(s_z);
+    first_ns = now();
+    distances.waitUntilPrecise();
+    precise_ns = now();
+  } else {
+    return 2;
+  }
+  std::printf("%lld %lld %.17g\n", static_cast<long long>(first_ns - spawn_ns),
+              static_cast<long long>(precise_ns - spawn_ns), first);
+  return 0;
+}
+
+struct Timing {
+  double first_ms;
+  double precise_ms;
+  double value;
+};
+
+/// Parent side: spawn a fresh process for the mode and collect what it printed
+bool spawnChild(const char* program_name, const std::string& mode, const std::string& table_path, Timing& timing) {
+  int pipe_fds[2];
+  if (pipe(pipe_fds) != 0) {
+    return false;
+  }
+  posix_spawn_file_actions_t actions;
+  posix_spawn_file_actions_init(&actions);
+  posix_spawn_file_actions_adddup2(&actions, pipe_fds[1], STDOUT_FILENO);
+  posix_spawn_file_actions_addclose(&actions, pipe_fds[0]);
+
+  std::string spawn_ns = std::to_string(now());
+  std::vector<char*> args{const_cast<char*>(program_name), const_cast<char*>("--child"),
+                          const_cast<char*>(mode.c_str()), const_cast<char*>(spawn_ns.c_str()),
+                          const_cast<char*>(table_path.c_str()), nullptr};
+  // The running binary itself, whatever argv[0] says or the PATH lookup it went through
+  pid_t pid    = 0;
+  int   status = posix_spawn(&pid, "/proc/self/exe", &actions, nullptr, args.data(), environ);
+  posix_spawn_file_actions_destroy(&actions);
+  close(pipe_fds[1]);
+  if (status != 0) {
+    close(pipe_fds[0]);
+    return false;
+  }
+
+  char    buffer[256] = {};
+  ssize_t read_bytes  = read(pipe_fds[0], buffer, sizeof(buffer) - 1);
+  close(pipe_fds[0]);
+  waitpid(pid, &status, 0);
+  long long first_ns = 0, precise_ns = 0;
+  if (read_bytes <= 0 || std::sscanf(buffer, "%lld %lld %lf", &first_ns, &precise_ns, &timing.value) != 3) {
+    return false;
+  }
+  timing.first_ms   = static_cast<double>(first_ns) * 1e-6;
+  timing.precise_ms = static_cast<double>(precise_ns) * 1e-6;
+  return WIFEXITED(status) && WEXITSTATUS(status) == 0;
+}
+
+double median(std::vector<double> values) {
+  std::sort(values.begin(), values.end());
+  return values[values.size() / 2];
+}
+
+}  // namespace
+
+int main(int argc, char* argv[]) {
+  if (argc == 5 && std::strcmp(argv[1], "--child") == 0) {
+    return child(argv[2], std::strtoll(argv[3], nullptr, 10), argv[4]);
+  }
+  const long repetitions = argc > 1 ? std::strtol(argv[1], nullptr, 10) : 21;
+  if (repetitions <= 0) {
+    std::cerr << "Usage: " << argv[0] << " [repetitions > 0]" << std::endl;
+    return 1;
+  }
+
+  // The baked table the table-load mode reads, as a job would find it on a shared file system
+  std::string table_path = "coldstart-table.bin";
+  {
+    std::ofstream file{table_path, std::ios::binary};
+    ComovingDistanceTable{CosmologicalDistances{}, s_parameters}.save(file);
+  }
+  // Converged far beyond the 1e-7 of the direct mode, so that its error shows too
+  const double reference = CosmologicalDistances{}.comovingDistance(s_z, s_parameters, QuadratureConvergence<>{1e-13});
+
+  std::cout << "Process spawn to first distance, median of " << repetitions << " runs" << std::endl;
+  std::cout << std::left << std::setw(14) << "mode" << std::right << std::setw(14) << "first [ms]" << std::setw(16)
+            << "precise [ms]" << std::setw(18) << "first rel. error" << std::endl;
+  for (const std::string mode : {"direct", "table-build", "table-load", "fast-start"}) {
+    std::vector<double> first, precise;
+    double              error = 0.;
+    for (long i = 0; i < repetitions; ++i) {
+      Timing timing{};
+      if (!spawnChild(argv[0], mode, table_path, timing)) {
+        std::cerr << "Failed to run the " << mode << " child" << std::endl;
+        return 1;
+      }
+      first.push_back(timing.first_ms);
+      precise.push_back(timing.precise_ms);
+      error = std::max(error, std::abs(timing.value - reference) / std::abs(reference));
+    }
+    std::cout << std::left << std::setw(14) << mode << std::right << std::fixed << std::setprecision(3)
+              << std::setw(14) << median(first) << std::setw(16) << median(precise) << std::scientific
+              << std::setprecision(2) << std::setw(18) << error << std::endl;
+  }
+  std::remove(table_path.c_str());
+  return 0;
+}
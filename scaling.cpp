@@ -0,0 +1,233 @@
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cstdlib>
+#include <fstream>
+#include <functional>
+#include <iomanip>
+#include <iostream>
+#include <string>
+#include <thread>
+#include <vector>
+#ifdef __linux__
+#include <pthread.h>
+#include <sched.h>
+#endif
+#include "CosmologicalDistances.h"
+#include "CosmologicalParameters.h"
+#include "DistanceTableCache.h"
+#include "ParallelDistances.h"
+#include "WorkloadGenerator.h"
+
+using namespace Euclid::PhysicsUtils;
+
+namespace {
+
+struct Cpu {
+  int id;
+  int package;
+  int core;
+};
+
+int readTopology(int cpu, const std::string& name) {
+  std::ifstream file{"/sys/devices/system/cpu/cpu" + std::to_string(cpu) + "/topology/" + name};
+  int           value = 0;
+  file >> value;
+  return value;
+}
+
+/// The CPUs we may run on, sorted by socket then core: a prefix of the list stays on one socket
+std::vector<Cpu> availableCpus() {
+  std::vector<Cpu> cpus;
+#ifdef __linux__
+  cpu_set_t set;
+  CPU_ZERO(&set);
+  if (sched_getaffinity(0, sizeof(set), &set) == 0) {
+    for (int cpu = 0; cpu < CPU_SETSIZE; ++cpu) {
+      if (CPU_ISSET(cpu, &set)) {
+        cpus.push_back(Cpu{cpu, readTopology(cpu, "physical_package_id"), readTopology(cpu, "core_id")});
+      }
+    }
+  }
+#endif
+  if (cpus.empty()) {
+    for (unsigned cpu = 0; cpu < std::max(1u, std::thread::hardware_concurrency()); ++cpu) {
+      cpus.push_back(Cpu{static_cast<int>(cpu), 0, static_cast<int>(cpu)});
+    }
+  }
+  std::stable_sort(cpus.begin(), cpus.end(), [](const Cpu& a, const Cpu& b) {
+    return a.package != b.package ? a.package < b.package : a.core < b.core;
+  });
+  return cpus;
+}
+
+/// Round-robin over the sockets, so that any two consecutive threads sit on different sockets
+std::vector<Cpu> scatter(const std::vector<Cpu>& compact) {
+  std::vector<std::vector<Cpu>> packages;
+  for (const auto& cpu : compact) {
+    if (packages.empty() || packages.back().front().package != cpu.package) {
+      packages.emplace_back();
+    }
+    packages.back().push_back(cpu);
+  }
+  std::vector<Cpu> result;
+  for (std::size_t i = 0; result.size() < compact.size(); ++i) {
+    for (const auto& package : packages) {
+      if (i < package.size()) {
+        result.push_back(package[i]);
+      }
+    }
+  }
+  return result;
+}
+
+void pin(std::thread& thread, int cpu) {
+#ifdef __linux__
+  cpu_set_t set;
+  CPU_ZERO(&set);
+  CPU_SET(cpu, &set);
+  pthread_setaffinity_np(thread.native_handle(), sizeof(set), &set);
+#else
+  (void)thread;
+  (void)cpu;
+#endif
+}
+
+/**
+ * Run kernel(thread_index, begin, end) on thread_count threads over count objects and return the
+ * wall time between the release of a start barrier and the end of the last thread.
+ */
+template <typename Kernel>
+double run(std::size_t thread_count, std::size_t count, const std::vector<Cpu>* placement, Kernel&& kernel) {
+  std::atomic<std::size_t> ready{0};
+  std::atomic<bool>        go{false};
+  std::vector<std::thread> threads;
+  std::size_t              chunk = (count + thread_count - 1) / thread_count;
+  for (std::size_t t = 0; t < thread_count; ++t) {
+    threads.emplace_back([&, t] {
+      ready.fetch_add(1);
+      while (!go.load(std::memory_order_acquire)) {
+      }
+      std::size_t begin = std::min(count, t * chunk);
+      kernel(t, begin, std::min(count, begin + chunk));
+    });
+    if (placement != nullptr) {
+      pin(threads.back(), (*placement)[t % placement->size()].id);
+    }
+  }
+  while (ready.load() != thread_count) {
+  }
+  auto start = std::chrono::steady_clock::now();
+  go.store(true, std::memory_order_release);
+  for (auto& thread : threads) {
+    thread.join();
+  }
+  return std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+}
+
+double g_sink = 0.;
+
+struct Scenario {
+  std::string             name;
+  const std::vector<Cpu>* placement;
+};
+
+}  // namespace
+
+int main(int argc, char* argv[]) {
+  std::size_t per_thread = argc > 1 ? std::strtoul(argv[1], nullptr, 10) : 1 << 18;
+  if (per_thread == 0) {
+    std::cerr << "Usage: " << argv[0] << " [objects per thread > 0]" << std::endl;
+    return 1;
+  }
+  auto        compact    = availableCpus();
+  auto        scattered  = scatter(compact);
+  std::size_t max_threads = compact.size();
+
+  std::vector<std::size_t> thread_counts;
+  for (std::size_t t = 1; t < max_threads; t *= 2) {
+    thread_counts.push_back(t);
+  }
+  thread_counts.push_back(max_threads);
+
+  WorkloadGenerator            generator{};
+  auto                         z = generator.redshifts(per_thread * max_threads);
+  std::vector<double>          out(z.size());
+  const CosmologicalParameters parameters{};
+  CosmologicalDistances        distances{};
+  DistanceTableCache           cache{};
+  auto                         table = cache.table(parameters);
+
+  using Kernel = std::function<void(std::size_t, std::size_t, std::size_t)>;
+  std::vector<std::pair<std::string, Kernel>> kernels{
+      {"batch", [&](std::size_t, std::size_t begin, std::size_t end) {
+         distances.transverseComovingDistance(z.data() + begin, end - begin, out.data() + begin, parameters);
+       }},
+      {"shared table", [&](std::size_t, std::size_t begin, std::size_t end) {
+         (*table)(z.data() + begin, end - begin, out.data() + begin);
+       }},
+      {"thread-local output", [&](std::size_t, std::size_t begin, std::size_t end) {
+         // Allocates its own output, exposing the allocator and first-touch page faults
+         std::vector<double> local(end - begin);
+         distances.transverseComovingDistance(z.data() + begin, end - begin, local.data(), parameters);
+         if (!local.empty()) {
+           out[begin] = local.back();
+         }
+       }},
+      {"shared cache lookups", [&](std::size_t, std::size_t begin, std::size_t end) {
+         // One lookup per block of 1024 objects, contending on the cache mutex
+         for (std::size_t i = begin; i < end; i += 1024) {
+           (*cache.table(parameters))(z.data() + i, std::min<std::size_t>(1024, end - i), out.data() + i);
+         }
+       }},
+  };
+
+  const std::vector<Scenario> scenarios{{"unpinned", nullptr}, {"pinned compact", &compact},
+                                        {"pinned scatter", &scattered}};
+
+  std::cout << max_threads << " CPUs on "
+            << (compact.empty() ? 0 : compact.back().package - compact.front().package + 1) << " socket(s), "
+            << per_thread << " objects per thread for the weak scaling" << std::endl;
+  std::cout << std::left << std::setw(22) << "kernel" << std::setw(16) << "placement" << std::setw(8) << "mode"
+            << std::right << std::setw(8) << "threads" << std::setw(12) << "Mobj/s" << std::setw(14)
+            << "Mobj/s/thread" << std::setw(12) << "efficiency" << std::endl;
+
+  for (const auto& kernel : kernels) {
+    for (const auto& scenario : scenarios) {
+      for (bool weak : {false, true}) {
+        double single_thread = 0.;
+        for (std::size_t threads : thread_counts) {
+          std::size_t count   = weak ? per_thread * threads : per_thread;
+          double      seconds = run(threads, count, scenario.placement, kernel.second);
+          double      rate    = static_cast<double>(count) / seconds;
+          if (threads == 1) {
+            single_thread = seconds;
+          }
+          double efficiency = weak ? single_thread / seconds : single_thread / (seconds * static_cast<double>(threads));
+          std::cout << std::left << std::setw(22) << kernel.first << std::setw(16) << scenario.name << std::setw(8)
+                    << (weak ? "weak" : "strong") << std::right << std::setw(8) << threads << std::fixed
+                    << std::setprecision(1) << std::setw(12) << rate * 1e-6 << std::setw(14)
+                    << rate * 1e-6 / static_cast<double>(threads) << std::setprecision(2) << std::setw(12)
+                    << efficiency << std::endl;
+          g_sink += out[0];
+        }
+      }
+    }
+  }
+
+  // The library-managed threads cannot be pinned, they are measured with the default placement
+  for (std::size_t threads : thread_counts) {
+    ParallelDistances parallel{threads};
+    auto              start = std::chrono::steady_clock::now();
+    parallel.transverseComovingDistance(z.data(), per_thread, out.data(), parameters);
+    double seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+    double rate    = static_cast<double>(per_thread) / seconds;
+    std::cout << std::left << std::setw(22) << "ParallelDistances" << std::setw(16) << "unpinned" << std::setw(8)
+              << "strong" << std::right << std::setw(8) << threads << std::fixed << std::setprecision(1)
+              << std::setw(12) << rate * 1e-6 << std::setw(14) << rate * 1e-6 / static_cast<double>(threads)
+              << std::endl;
+    g_sink += out[0];
+  }
+
+  return g_sink == 0. ? 1 : 0;
+}
@@ -0,0 +1,79 @@
+#include <chrono>
+#include <cmath>
+#include <cstdlib>
+#include <iomanip>
+#include <iostream>
+#include <string>
+#include "ComovingDistanceTable.h"
+#include "CosmologicalDistances.h"
+#include "CosmologicalParameters.h"
+#include "FloatVerification.h"
+
+using namespace Euclid::PhysicsUtils;
+
+namespace {
+
+template <typename Kernel, typename Reference>
+void verify(const FloatVerification& verification, const std::string& name, Kernel kernel, Reference reference,
+            float lower, float upper) {
+  auto      start   = std::chrono::steady_clock::now();
+  UlpReport report  = verification.run(kernel, reference, lower, upper);
+  double    seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+  std::cout << std::left << std::setw(18) << name << std::right << std::setw(12) << report.count << " floats "
+            << std::fixed << std::setprecision(2) << std::setw(7) << seconds << " s  max " << std::setprecision(3)
+            << report.max_ulps << " ULP at x = " << std::setprecision(9) << std::defaultfloat << report.worst_input
+            << " (" << report.worst_result << " vs " << std::setprecision(17) << report.worst_reference << ")";
+  if (report.non_finite_mismatches != 0) {
+    std::cout << ", " << report.non_finite_mismatches << " non-finite mismatches from x = "
+              << report.first_non_finite_mismatch;
+  }
+  std::cout << std::endl;
+}
+
+}  // namespace
+
+int main(int argc, char* argv[]) {
+  FloatVerification verification{argc > 1 ? std::strtoul(argv[1], nullptr, 10)
+                                          : std::thread::hardware_concurrency()};
+  const CosmologicalParameters parameters{};
+  const CosmologicalDistances  distances{};
+
+  const float omega_m = static_cast<float>(parameters.getOmegaM());
+  const float omega_k = static_cast<float>(parameters.getOmegaK());
+  const float omega_l = static_cast<float>(parameters.getOmegaLambda());
+  verify(
+      verification, "integrand 1/E(z)",
+      [=](float z) {
+        const float x = 1.f + z;
+        return 1.f / std::sqrt((omega_m * x + omega_k) * x * x + omega_l);
+      },
+      [&](double z) { return 1. / distances.hubbleParameter(z, parameters); }, 0.f, 20.f);
+
+  verify(
+      verification, "sinh", [](float x) { return std::sinh(x); }, [](double x) { return std::sinh(x); }, -90.f, 90.f);
+  verify(
+      verification, "sin", [](float x) { return std::sin(x); }, [](double x) { return std::sin(x); }, 0.f,
+      3.14159274f);
+  verify(
+      verification, "log10", [](float x) { return std::log10(x); }, [](double x) { return std::log10(x); }, 0.f,
+      std::numeric_limits<float>::infinity());
+
+  // A float copy of a distance table against the double original
+  const ComovingDistanceTable table{distances, parameters};
+  std::vector<float>          values(table.data(), table.data() + table.size());
+  const float                 inverse_step = static_cast<float>(1. / table.getStep());
+  verify(
+      verification, "table lookup",
+      [&](float z) {
+        const float position = z * inverse_step;
+        std::size_t index    = std::min(static_cast<std::size_t>(position), values.size() - 2);
+        const float t        = position - static_cast<float>(index);
+        return values[index] + t * (values[index + 1] - values[index]);
+      },
+      [&](double z) { return table(z); }, 0.f, static_cast<float>(table.getZMax()));
+
+  verify(
+      verification, "all 2^32: -x", [](float x) { return -x; }, [](double x) { return -x; },
+      -std::numeric_limits<float>::infinity(), std::numeric_limits<float>::infinity());
+  return 0;
+}